@@ -17,11 +17,15 @@ local bit = require("bit")
 -- Symbol name prefix for LuaJIT bytecode.
 local LJBC_PREFIX = "luaJIT_BC_"
 
+-- Magic and version of module bundles. Must match lib_package.c.
+local BUNDLE_MAGIC, BUNDLE_VERSION = "\027LJB", 1
+
 ------------------------------------------------------------------------------
 
 local function usage()
   io.stderr:write[[
 Save LuaJIT bytecode: luajit -b[options] input output
+Save module bundle:   luajit -bm[options] output input...
   -l        Only list bytecode.
   -s        Strip debug info (default).
   -g        Keep debug info.
@@ -30,6 +34,8 @@ Save LuaJIT bytecode: luajit -b[options] input output
   -a arch   Override architecture for object files (default: native).
   -o os     Override OS for object files (default: native).
   -e chunk  Use chunk string as input.
+  -m        Save a bundle of modules (default: auto-detect module names).
+  -j jobs   Compile bundle modules with parallel processes (default: 1).
   --        Stop handling options.
   -         Use stdin as input and/or stdout as output.
 
@@ -571,6 +577,77 @@ local function bcsave_obj(ctx, output, s)
   end
 end
 
+local function bundlemodname(str)
+  if type(str) ~= "string" then usage() end
+  local s = string.gsub(str, "^%.[/\\]", "")
+  s = string.gsub(s, "%.[^./\\]*$", "")
+  s = string.gsub(s, "[/\\]init$", "")
+  s = string.gsub(s, "[/\\]", ".")
+  check(string.match(s, "^[%w_.%-]+$"), "cannot derive module name from ", str)
+  return s
+end
+
+-- Little-endian uint32_t.
+local function u32(x)
+  local band, shr = bit.band, bit.rshift
+  return string.char(band(x, 255), band(shr(x, 8), 255),
+		     band(shr(x, 16), 255), shr(x, 24))
+end
+
+-- FNV-1a hash of the module name. Must match lib_package.c.
+local function bundlehash(s)
+  local h = bit.tobit(0x811c9dc5)
+  for i=1,#s do
+    h = bit.bxor(h, string.byte(s, i))
+    h = bit.tobit(bit.lshift(h, 24) + h*403)  -- h*16777619 (mod 2^32)
+  end
+  return h
+end
+
+-- Bundle layout, all fields are little-endian uint32_t:
+--   magic (4 bytes), version, number of slots (power of 2), number of modules
+--   slots: hash, name offset, bytecode offset, bytecode length
+--   data: zero-terminated names and bytecode
+-- Empty slots are all zero. Lookups use linear probing from hash & (n-1).
+local function bcsave_bundle(output, mods)
+  local nslot = 4
+  while nslot < 2*#mods do nslot = nslot + nslot end
+  local slots, data = {}, {}
+  local ofs = 16 + 16*nslot
+  for i=1,#mods do
+    local m = mods[i]
+    local h = bundlehash(m.name)
+    local slot = bit.band(h, nslot-1)
+    while slots[slot] do
+      check(slots[slot].name ~= m.name, "duplicate module name ", m.name)
+      slot = bit.band(slot+1, nslot-1)
+    end
+    slots[slot] = m
+    m.hash, m.nameofs, m.bcofs = h, ofs, ofs + #m.name + 1
+    data[i] = m.name.."\0"..m.bc
+    ofs = m.bcofs + #m.bc
+  end
+  local t = { BUNDLE_MAGIC, u32(BUNDLE_VERSION), u32(nslot), u32(#mods) }
+  for slot=0,nslot-1 do
+    local m = slots[slot]
+    t[slot+5] = m and u32(m.hash)..u32(m.nameofs)..u32(m.bcofs)..u32(#m.bc)
+		or string.rep("\0", 16)
+  end
+  bcsave_raw(output, table.concat(t)..table.concat(data))
+end
+
+-- Get the command to run this interpreter, e.g. for worker processes.
+local function interpreter()
+  local n = -1
+  while arg and arg[n-1] do n = n - 1 end
+  return check(arg and arg[n], "cannot determine interpreter name")
+end
+
+local function shellquote(s)
+  if jit.os == "Windows" then return '"'..s..'"' end
+  return "'"..string.gsub(s, "'", "'\\''").."'"
+end
+
 ------------------------------------------------------------------------------
 
 local function bclist(input, output)
@@ -598,13 +675,50 @@ local function bcsave(ctx, input, output)
   end
 end
 
+-- Compile the modules with up to ctx.jobs worker processes in parallel.
+-- Each worker is a 'luajit -b' writing raw bytecode to a pipe.
+local function bcbundle_jobs(ctx, mods, inputs)
+  local cmd = shellquote(interpreter())..(ctx.strip and " -bs" or " -bg")..
+	      " -t raw -- "
+  local mode = jit.os == "Windows" and "rb" or "r"
+  local fps = {}
+  local function collect(i)
+    local fp = fps[i]
+    local s = fp:read("*a")
+    fp:close()
+    fps[i] = nil
+    check(s and string.sub(s, 1, 3) == "\027LJ", "cannot compile ", inputs[i])
+    mods[i].bc = s
+  end
+  for i=1,#inputs do
+    if i > ctx.jobs then collect(i - ctx.jobs) end
+    fps[i] = check(io.popen(cmd..shellquote(inputs[i]).." -", mode))
+  end
+  for i=math.max(#inputs - ctx.jobs, 0)+1,#inputs do collect(i) end
+end
+
+local function bcbundle(ctx, output, inputs)
+  check((ctx.type or detecttype(output)) == "raw",
+	"bundles must use raw file type")
+  local mods = {}
+  for i=1,#inputs do mods[i] = { name = bundlemodname(inputs[i]) } end
+  if ctx.jobs > 1 then
+    bcbundle_jobs(ctx, mods, inputs)
+  else
+    for i=1,#inputs do
+      mods[i].bc = string.dump(readfile(inputs[i]), ctx.strip)
+    end
+  end
+  bcsave_bundle(output, mods)
+end
+
 local function docmd(...)
   local arg = {...}
   local n = 1
-  local list = false
+  local list, bundle = false, false
   local ctx = {
     strip = true, arch = jit.arch, os = string.lower(jit.os),
-    type = false, modname = false,
+    type = false, modname = false, jobs = 1,
   }
   while n <= #arg do
     local a = arg[n]
@@ -619,6 +733,8 @@ local function docmd(...)
 	  ctx.strip = true
 	elseif opt == "g" then
 	  ctx.strip = false
+	elseif opt == "m" then
+	  bundle = true
 	else
 	  if arg[n] == nil or m ~= #a then usage() end
 	  if opt == "e" then
@@ -632,6 +748,10 @@ local function docmd(...)
 	    ctx.arch = checkarg(table.remove(arg, n), map_arch, "architecture")
 	  elseif opt == "o" then
 	    ctx.os = checkarg(table.remove(arg, n), map_os, "OS name")
+	  elseif opt == "j" then
+	    local jobs = tonumber(table.remove(arg, n))
+	    check(jobs and jobs >= 1 and jobs % 1 == 0, "bad number of jobs")
+	    ctx.jobs = jobs
 	  else
 	    usage()
 	  end
@@ -641,7 +761,10 @@ local function docmd(...)
       n = n + 1
     end
   end
-  if list then
+  if bundle then
+    if list or #arg < 2 or type(arg[1]) ~= "string" then usage() end
+    bcbundle(ctx, table.remove(arg, 1), arg)
+  elseif list then
     if #arg == 0 or #arg > 2 then usage() end
     bclist(arg[1], arg[2] or "-")
   else
@@ -14,6 +14,7 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
+#include "luajit.h"
 
 #include "lj_obj.h"
 #include "lj_gc.h"
@@ -358,7 +359,7 @@ LJLIB_ASM_(xpcall)		LJLIB_REC(.)
 static int load_aux(lua_State *L, int status, int envarg)
 {
   if (status == 0) {
-    if (tvistab(L->base+envarg-1)) {
+    if (tvisfunc(L->top-1) && tvistab(L->base+envarg-1)) {
       GCfunc *fn = funcV(L->top-1);
       GCtab *t = tabV(L->base+envarg-1);
       setgcref(fn->c.env, obj2gco(t));
@@ -648,6 +649,17 @@ LJLIB_CF(coroutine_wrap)
   return 1;
 }
 
+LJLIB_CF(coroutine_pool)
+{
+  global_State *g = G(L);
+  luaJIT_threadpool(L, lj_lib_optint(L, 1, -1));
+  setintV(L->top++, (int32_t)g->thpool.max);
+  setintV(L->top++, (int32_t)g->thpool.num);
+  setintV(L->top++, (int32_t)g->thpool.reused);
+  setintV(L->top++, (int32_t)g->thpool.created);
+  return 4;
+}
+
 #include "lj_libdef.h"
 
 /* Fix the PC of wrap_aux. Really ugly workaround. */
@@ -24,6 +24,17 @@
 #include "lj_ff.h"
 #include "lj_lib.h"
 
+#if LJ_TARGET_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#elif LJ_TARGET_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
 /* Userdata payload for I/O file. */
 typedef struct IOFileUD {
   FILE *fp;		/* File handle. */
@@ -37,6 +48,16 @@ typedef struct IOFileUD {
 
 #define IOFILE_FLAG_CLOSE	4	/* Close after io.lines() iterator. */
 
+/* Userdata payload for memory-mapped file. */
+typedef struct IOMmapUD {
+  char *p;		/* Start of mapping. */
+  size_t len;		/* Length of mapping. */
+  uint32_t flags;	/* Flags. */
+} IOMmapUD;
+
+#define IOMMAP_FLAG_OPEN	1	/* Mapping is valid (even if empty). */
+#define IOMMAP_FLAG_WRITE	2	/* Writable mapping. */
+
 #define IOSTDF_UD(L, id)	(&gcref(G(L)->gcroot[(id)])->ud)
 #define IOSTDF_IOF(L, id)	((IOFileUD *)uddata(IOSTDF_UD(L, (id))))
 
@@ -140,6 +161,64 @@ static int io_file_readnum(lua_State *L, FILE *fp)
   }
 }
 
+#if defined(__GLIBC__) && !defined(__UCLIBC__)
+/* Direct access to the stdio read buffer. See also gnulib's freadptr(). */
+#define IO_READPTR		1
+#endif
+
+/* Buffer size for files opened with io.open() for reading. */
+#define IO_READBUFSIZE		65536
+
+#if IO_READPTR
+/* Get temp. buffer with at least sz bytes. Grows geometrically. */
+static char *io_needbuf(lua_State *L, MSize sz)
+{
+  SBuf *sb = &G(L)->tmpbuf;
+  return lj_str_needbuf(L, sb, sz <= sb->sz ? sz : sz + sz);
+}
+
+/* Read a line straight from the stdio buffer into the temp. buffer. The
+** FILE is locked while its buffer is accessed, since C code in other
+** threads may share it (e.g. stdin). Nothing which may throw is called
+** with the lock held, so the temp. buffer is grown before taking it.
+*/
+static int io_file_readline(lua_State *L, FILE *fp, MSize chop)
+{
+  SBuf *sb = &G(L)->tmpbuf;
+  MSize n = 0;
+  int ok = 0;
+  char *buf = NULL;
+  for (;;) {
+    const char *p, *e, *q;
+    MSize m, len;
+    buf = io_needbuf(L, n+LUAL_BUFFERSIZE);
+    m = sb->sz - n;
+    flockfile(fp);
+    p = fp->_IO_read_ptr; e = fp->_IO_read_end;
+    if (p >= e) {
+      int c = getc_unlocked(fp);  /* Refill stdio buffer. */
+      if (c == EOF) { funlockfile(fp); break; }
+      buf[n++] = (char)c;
+      ok = 1;
+      if (c == '\n') { funlockfile(fp); n -= chop; break; }
+      m--;
+      p = fp->_IO_read_ptr; e = fp->_IO_read_end;
+    }
+    if ((MSize)(e-p) > m) e = p+m;
+    q = (const char *)memchr(p, '\n', (size_t)(e-p));
+    len = (MSize)((q ? q+1 : e) - p);
+    memcpy(buf+n, p, len);
+    fp->_IO_read_ptr = (char *)p+len;
+    funlockfile(fp);
+    n += len;
+    if (len) ok = 1;
+    if (q) { n -= chop; break; }
+  }
+  setstrV(L, L->top++, lj_str_new(L, buf, (size_t)n));
+  lj_gc_check(L);
+  return ok;
+}
+#else
 static int io_file_readline(lua_State *L, FILE *fp, MSize chop)
 {
   MSize m = LUAL_BUFFERSIZE, n = 0, ok = 0;
@@ -156,6 +235,7 @@ static int io_file_readline(lua_State *L, FILE *fp, MSize chop)
   lj_gc_check(L);
   return (int)ok;
 }
+#endif
 
 static void io_file_readall(lua_State *L, FILE *fp)
 {
@@ -239,7 +319,14 @@ static int io_file_write(lua_State *L, FILE *fp, int start)
       size_t len = (size_t)(buf+LJ_STR_INTBUF-p);
       status = status && (fwrite(p, 1, len, fp) == len);
     } else if (tvisnum(tv)) {
-      status = status && (fprintf(fp, LUA_NUMBER_FMT, numV(tv)) > 0);
+      char buf[LJ_STR_NUMBUF];
+      size_t len = 0;
+      if (LJ_LIKELY((tv->u32.hi << 1) < 0xffe00000))  /* Finite? */
+	len = lj_str_bufnumg(buf, numV(tv), 14);  /* Same as LUA_NUMBER_FMT. */
+      if (LJ_LIKELY(len))
+	status = status && (fwrite(buf, 1, len, fp) == len);
+      else
+	status = status && (fprintf(fp, LUA_NUMBER_FMT, numV(tv)) > 0);
     } else {
       lj_err_argt(L, (int)(tv - L->base) + 1, LUA_TSTRING);
     }
@@ -287,6 +374,179 @@ static int io_file_lines(lua_State *L)
   return 1;
 }
 
+/* -- Memory-mapped files ------------------------------------------------- */
+
+static IOMmapUD *io_tommapp(lua_State *L)
+{
+  if (!(L->base < L->top && tvisudata(L->base) &&
+	udataV(L->base)->udtype == UDTYPE_IO_MMAP))
+    lj_err_argtype(L, 1, "mmap");
+  return (IOMmapUD *)uddata(udataV(L->base));
+}
+
+static IOMmapUD *io_tommap(lua_State *L)
+{
+  IOMmapUD *iom = io_tommapp(L);
+  if (!(iom->flags & IOMMAP_FLAG_OPEN))
+    lj_err_caller(L, LJ_ERR_IOCLFL);
+  return iom;
+}
+
+/* Map whole file. Returns 0 and sets errno on failure. */
+static int io_mmap_map(IOMmapUD *iom, const char *fname)
+{
+  int rw = (iom->flags & IOMMAP_FLAG_WRITE);
+#if LJ_TARGET_POSIX
+  struct stat st;
+  int err, fd = open(fname, rw ? O_RDWR : O_RDONLY);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) == 0) {
+    if ((uint64_t)st.st_size > (uint64_t)(~(size_t)0 >> 1)) {
+      errno = EFBIG;
+    } else if (st.st_size == 0) {  /* Cannot map empty files. */
+      close(fd);
+      return 1;
+    } else {
+      void *p = mmap(NULL, (size_t)st.st_size,
+		     rw ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) {
+	iom->p = (char *)p;
+	iom->len = (size_t)st.st_size;
+	close(fd);
+	return 1;
+      }
+    }
+  }
+  err = errno;
+  close(fd);
+  errno = err;
+  return 0;
+#elif LJ_TARGET_WINDOWS
+  HANDLE fh, mh;
+  LARGE_INTEGER sz;
+  fh = CreateFileA(fname, rw ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ,
+		   FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+		   FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fh == INVALID_HANDLE_VALUE) { errno = ENOENT; return 0; }
+  if (!GetFileSizeEx(fh, &sz) ||
+      (uint64_t)sz.QuadPart > (uint64_t)(~(size_t)0 >> 1)) {
+    CloseHandle(fh);
+    errno = EFBIG;
+    return 0;
+  }
+  if (sz.QuadPart == 0) {  /* Cannot map empty files. */
+    CloseHandle(fh);
+    return 1;
+  }
+  mh = CreateFileMappingA(fh, NULL, rw ? PAGE_READWRITE : PAGE_READONLY,
+			  0, 0, NULL);
+  CloseHandle(fh);
+  if (mh == NULL) { errno = EACCES; return 0; }
+  iom->p = (char *)MapViewOfFile(mh, rw ? FILE_MAP_WRITE : FILE_MAP_READ,
+				 0, 0, 0);
+  CloseHandle(mh);
+  if (iom->p == NULL) { errno = ENOMEM; return 0; }
+  iom->len = (size_t)sz.QuadPart;
+  return 1;
+#else
+  UNUSED(rw); UNUSED(fname);
+  errno = ENOSYS;
+  return 0;
+#endif
+}
+
+static void io_mmap_unmap(IOMmapUD *iom)
+{
+  if (iom->p) {
+#if LJ_TARGET_POSIX
+    munmap(iom->p, iom->len);
+#elif LJ_TARGET_WINDOWS
+    UnmapViewOfFile(iom->p);
+#endif
+  }
+  iom->p = NULL;
+  iom->len = 0;
+  iom->flags &= ~IOMMAP_FLAG_OPEN;
+}
+
+#define LJLIB_MODULE_io_mmap_method
+
+LJLIB_CF(io_mmap_method_close)
+{
+  io_mmap_unmap(io_tommap(L));
+  setboolV(L->top++, 1);
+  return 1;
+}
+
+LJLIB_CF(io_mmap_method_len)
+{
+  setnumV(L->top++, (lua_Number)io_tommap(L)->len);
+  return 1;
+}
+
+/* Get a position argument, clamped to +-(len+1). NaN gives 0. */
+static ptrdiff_t io_mmap_checkpos(lua_State *L, int narg, ptrdiff_t len)
+{
+  lua_Number n = lj_lib_checknum(L, narg);
+  lua_Number lim = (lua_Number)(len+1);
+  if (n > lim) return len+1;
+  if (n < -lim) return -(len+1);
+  return n == n ? (ptrdiff_t)n : 0;
+}
+
+LJLIB_CF(io_mmap_method_sub)
+{
+  IOMmapUD *iom = io_tommap(L);
+  ptrdiff_t len = (ptrdiff_t)iom->len;
+  ptrdiff_t start = io_mmap_checkpos(L, 2, len);
+  ptrdiff_t end = L->base+2 < L->top && !tvisnil(L->base+2) ?
+		  io_mmap_checkpos(L, 3, len) : -1;
+  if (end < 0) end += len+1; else if (end > len) end = len;
+  if (start < 0) start += len+1;
+  if (start < 1) start = 1;
+  if (start <= end)
+    setstrV(L, L->top++,
+	    lj_str_new(L, iom->p+start-1, (size_t)(end-start+1)));
+  else
+    setstrV(L, L->top++, &G(L)->strempty);
+  lj_gc_check(L);
+  return 1;
+}
+
+LJLIB_CF(io_mmap_method_ptr)
+{
+  setlightudV(L->top++, checklightudptr(L, io_tommap(L)->p));
+  return 1;
+}
+
+LJLIB_CF(io_mmap_method___gc)
+{
+  IOMmapUD *iom = io_tommapp(L);
+  if ((iom->flags & IOMMAP_FLAG_OPEN))
+    io_mmap_unmap(iom);
+  return 0;
+}
+
+LJLIB_CF(io_mmap_method___len)
+{
+  setnumV(L->top++, (lua_Number)io_tommap(L)->len);
+  return 1;
+}
+
+LJLIB_CF(io_mmap_method___tostring)
+{
+  IOMmapUD *iom = io_tommapp(L);
+  if ((iom->flags & IOMMAP_FLAG_OPEN))
+    lua_pushfstring(L, "mmap (%p)", iom);
+  else
+    lua_pushliteral(L, "mmap (closed)");
+  return 1;
+}
+
+LJLIB_PUSH(top-1) LJLIB_SET(__index)
+
+#include "lj_libdef.h"
+
 /* -- I/O file methods ---------------------------------------------------- */
 
 #define LJLIB_MODULE_io_method
@@ -408,7 +668,11 @@ LJLIB_CF(io_open)
   const char *mode = s ? strdata(s) : "r";
   IOFileUD *iof = io_file_new(L);
   iof->fp = fopen(fname, mode);
-  return iof->fp != NULL ? 1 : luaL_fileresult(L, 0, fname);
+  if (iof->fp == NULL)
+    return luaL_fileresult(L, 0, fname);
+  if (mode[0] == 'r' && !strchr(mode, '+'))  /* Read-only: larger blocks. */
+    setvbuf(iof->fp, NULL, _IOFBF, IO_READBUFSIZE);
+  return 1;
 }
 
 LJLIB_CF(io_popen)
@@ -503,6 +767,30 @@ LJLIB_CF(io_lines)
   return io_file_lines(L);
 }
 
+LJLIB_PUSH(top-3) LJLIB_SET(!)  /* Environment is mmap metatable. */
+
+LJLIB_CF(io_mmap)
+{
+  const char *fname = strdata(lj_lib_checkstr(L, 1));
+  GCstr *s = lj_lib_optstr(L, 2);
+  IOMmapUD *iom = (IOMmapUD *)lua_newuserdata(L, sizeof(IOMmapUD));
+  GCudata *ud = udataV(L->top-1);
+  ud->udtype = UDTYPE_IO_MMAP;
+  iom->p = NULL;
+  iom->len = 0;
+  iom->flags = 0;
+  if (s && strchr(strdata(s), 'w'))
+    iom->flags |= IOMMAP_FLAG_WRITE;
+  else if (s && strcmp(strdata(s), "r") != 0)
+    lj_err_arg(L, 2, LJ_ERR_INVOPT);
+  if (!io_mmap_map(iom, fname))
+    return luaL_fileresult(L, 0, fname);
+  iom->flags |= IOMMAP_FLAG_OPEN;
+  /* NOBARRIER: The GCudata is new (marked white). */
+  setgcrefr(ud->metatable, curr_func(L)->c.env);
+  return 1;
+}
+
 LJLIB_CF(io_type)
 {
   cTValue *o = lj_lib_checkany(L, 1);
@@ -534,6 +822,7 @@ static GCobj *io_std_new(lua_State *L, FILE *fp, const char *name)
 
 LUALIB_API int luaopen_io(lua_State *L)
 {
+  LJ_LIB_REG(L, NULL, io_mmap_method);
   LJ_LIB_REG(L, NULL, io_method);
   copyTV(L, L->top, L->top-1); L->top++;
   lua_setfield(L, LUA_REGISTRYINDEX, LUA_FILEHANDLE);
@@ -22,6 +22,7 @@
 #include "lj_jit.h"
 #include "lj_ircall.h"
 #include "lj_iropt.h"
+#include "lj_snap.h"
 #include "lj_target.h"
 #endif
 #include "lj_dispatch.h"
@@ -280,9 +281,25 @@ static GCtrace *jit_checktrace(lua_State *L)
 /* Names of link types. ORDER LJ_TRLINK */
 static const char *const jit_trlinkname[] = {
   "none", "root", "loop", "tail-recursion", "up-recursion", "down-recursion",
-  "interpreter", "return"
+  "interpreter", "return", "stitch"
 };
 
+/* Size of the snapshot maps of a trace without compression. */
+static MSize jit_snapmapsize(GCtrace *T)
+{
+  SnapEntry mapbuf[SNAP_MAXMAP];
+  MSize sz = 0;
+  SnapNo sn;
+  for (sn = 0; sn < T->nsnap; sn++) {
+    SnapEntry *map = lj_snap_map(T, sn, mapbuf);
+    MSize n, nent = T->snap[sn].nent;
+    sz += nent+1;
+    for (n = 0; n < nent; n++)
+      sz += ((map[n] & (SNAP_CONT|SNAP_FRAME)) && snap_slot(map[n]) != 0);
+  }
+  return sz*(MSize)sizeof(SnapEntry);
+}
+
 /* local info = jit.util.traceinfo(tr) */
 LJLIB_CF(jit_util_traceinfo)
 {
@@ -295,6 +312,8 @@ LJLIB_CF(jit_util_traceinfo)
     setintfield(L, t, "nk", REF_BIAS - (int32_t)T->nk);
     setintfield(L, t, "link", T->link);
     setintfield(L, t, "nexit", T->nsnap);
+    setintfield(L, t, "snapmap", (int32_t)(T->nsnapmap*sizeof(SnapEntry)));
+    setintfield(L, t, "snapmapfull", (int32_t)jit_snapmapsize(T));
     setstrV(L, L->top++, lj_str_newz(L, jit_trlinkname[T->linktype]));
     lua_setfield(L, -2, "linktype");
     /* There are many more fields. Add them only when needed. */
@@ -350,7 +369,8 @@ LJLIB_CF(jit_util_tracesnap)
   SnapNo sn = (SnapNo)lj_lib_checkint(L, 2);
   if (T && sn < T->nsnap) {
     SnapShot *snap = &T->snap[sn];
-    SnapEntry *map = &T->snapmap[snap->mapofs];
+    SnapEntry mapbuf[SNAP_MAXMAP];
+    SnapEntry *map = lj_snap_map(T, sn, mapbuf);
     MSize n, nent = snap->nent;
     GCtab *t;
     lua_createtable(L, nent+2, 0);
@@ -378,6 +398,24 @@ LJLIB_CF(jit_util_tracemc)
   return 0;
 }
 
+/* local info = jit.util.mcodeinfo() */
+LJLIB_CF(jit_util_mcodeinfo)
+{
+  jit_State *J = L2J(L);
+  size_t maxfree = (size_t)((char *)J->mctop - (char *)J->mcbot);
+  uint32_t i;
+  GCtab *t;
+  for (i = 0; i < J->nmcfree; i++)
+    if (J->mcfree[i].size > maxfree) maxfree = J->mcfree[i].size;
+  lua_createtable(L, 0, 4);  /* Increment hash size if fields are added. */
+  t = tabV(L->top-1);
+  setintfield(L, t, "total", (int32_t)J->szallmcarea);
+  setintfield(L, t, "free", (int32_t)J->szmcfree);
+  setintfield(L, t, "nfree", (int32_t)J->nmcfree);
+  setintfield(L, t, "maxfree", (int32_t)maxfree);
+  return 1;
+}
+
 /* local addr = jit.util.traceexitstub([tr,] exitno) */
 LJLIB_CF(jit_util_traceexitstub)
 {
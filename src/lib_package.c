@@ -17,6 +17,14 @@
 #include "lj_err.h"
 #include "lj_lib.h"
 
+#if LJ_TARGET_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 /* ------------------------------------------------------------------------ */
 
 /* Error codes for ll_loadfunc. */
@@ -333,17 +341,6 @@ static void loaderror(lua_State *L, const char *filename)
 	     lua_tostring(L, 1), filename, lua_tostring(L, -1));
 }
 
-static int lj_cf_package_loader_lua(lua_State *L)
-{
-  const char *filename;
-  const char *name = luaL_checkstring(L, 1);
-  filename = findfile(L, name, "path");
-  if (filename == NULL) return 1;  /* library not found in this path */
-  if (luaL_loadfile(L, filename) != 0)
-    loaderror(L, filename);
-  return 1;  /* library loaded successfully */
-}
-
 static int lj_cf_package_loader_c(lua_State *L)
 {
   const char *name = luaL_checkstring(L, 1);
@@ -389,6 +386,186 @@ static int lj_cf_package_loader_preload(lua_State *L)
   return 1;
 }
 
+/* -- Module bundles ------------------------------------------------------ */
+
+/* Bundle file format, see jit/bcsave.lua. All fields are little-endian. */
+#define BUNDLE_MAGIC		"\033LJB"
+#define BUNDLE_VERSION		1
+#define BUNDLE_HDRSIZE		16
+#define BUNDLE_SLOTSIZE		16
+
+typedef struct Bundle {
+  const uint8_t *p;	/* Start of mapped file. */
+  size_t len;		/* Length of mapped file. */
+} Bundle;
+
+static uint32_t bundle_u32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	 ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Map bundle file read-only. Returns 0 on failure. */
+static int bundle_map(Bundle *b, const char *fname)
+{
+#if LJ_TARGET_POSIX
+  struct stat st;
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) == 0 && st.st_size >= BUNDLE_HDRSIZE &&
+      (uint64_t)st.st_size <= (uint64_t)(~(size_t)0 >> 1)) {
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      b->p = (const uint8_t *)p;
+      b->len = (size_t)st.st_size;
+    }
+  }
+  close(fd);
+  return b->p != NULL;
+#elif LJ_TARGET_WINDOWS
+  HANDLE fh, mh;
+  LARGE_INTEGER sz;
+  fh = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		   FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fh == INVALID_HANDLE_VALUE) return 0;
+  if (!GetFileSizeEx(fh, &sz) || sz.QuadPart < BUNDLE_HDRSIZE ||
+      (uint64_t)sz.QuadPart > (uint64_t)(~(size_t)0 >> 1)) {
+    CloseHandle(fh);
+    return 0;
+  }
+  mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(fh);
+  if (mh == NULL) return 0;
+  b->p = (const uint8_t *)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mh);
+  b->len = (size_t)sz.QuadPart;
+  return b->p != NULL;
+#else
+  UNUSED(b); UNUSED(fname);
+  return 0;
+#endif
+}
+
+static int lj_cf_package_unloadbundle(lua_State *L)
+{
+  Bundle *b = (Bundle *)luaL_checkudata(L, 1, "_LOADBUNDLE");
+  if (b->p) {
+#if LJ_TARGET_POSIX
+    munmap((void *)b->p, b->len);
+#elif LJ_TARGET_WINDOWS
+    UnmapViewOfFile(b->p);
+#endif
+    b->p = NULL;
+  }
+  return 0;
+}
+
+/* Get mapped bundle. Cached in the registry, like loaded libraries. */
+static Bundle *bundle_get(lua_State *L, const char *fname)
+{
+  Bundle *b;
+  uint32_t nslot;
+  lua_pushfstring(L, "LOADBUNDLE: %s", fname);
+  lua_gettable(L, LUA_REGISTRYINDEX);
+  b = (Bundle *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (b) return b;
+  b = (Bundle *)lua_newuserdata(L, sizeof(Bundle));
+  b->p = NULL;
+  b->len = 0;
+  luaL_getmetatable(L, "_LOADBUNDLE");
+  lua_setmetatable(L, -2);
+  if (!bundle_map(b, fname) || memcmp(b->p, BUNDLE_MAGIC, 4) ||
+      bundle_u32(b->p+4) != BUNDLE_VERSION ||
+      (nslot = bundle_u32(b->p+8)) == 0 || (nslot & (nslot-1)) ||
+      nslot > (b->len - BUNDLE_HDRSIZE) / BUNDLE_SLOTSIZE) {
+    lua_pop(L, 1);  /* Unmapped by the __gc metamethod. */
+    return NULL;
+  }
+  lua_pushfstring(L, "LOADBUNDLE: %s", fname);
+  lua_pushvalue(L, -2);
+  lua_settable(L, LUA_REGISTRYINDEX);
+  lua_pop(L, 1);
+  return b;
+}
+
+/* Find bytecode of a module with a hash lookup. Returns NULL if missing. */
+static const char *bundle_find(Bundle *b, const char *name, size_t *sz)
+{
+  size_t len = strlen(name);
+  uint32_t h = 0x811c9dc5u, mask = bundle_u32(b->p+8)-1, i, n;
+  for (i = 0; i < len; i++)
+    h = (h ^ (uint8_t)name[i]) * 16777619u;  /* FNV-1a */
+  for (i = h & mask, n = mask+1; n > 0; i = (i+1) & mask, n--) {
+    const uint8_t *slot = b->p + BUNDLE_HDRSIZE + i*BUNDLE_SLOTSIZE;
+    uint32_t nameofs = bundle_u32(slot+4), ofs = bundle_u32(slot+8);
+    if (ofs == 0) break;  /* Empty slot. */
+    if (bundle_u32(slot) == h && nameofs < b->len &&
+	len < b->len - nameofs && !memcmp(b->p+nameofs, name, len+1)) {
+      uint32_t bclen = bundle_u32(slot+12);
+      if (ofs > b->len || bclen > b->len - ofs) break;
+      *sz = bclen;
+      return (const char *)b->p + ofs;
+    }
+  }
+  return NULL;
+}
+
+/* Load module from the bundles. Otherwise push error message and return 0. */
+static int bundle_load(lua_State *L, const char *name)
+{
+  const char *path;
+  lua_getfield(L, LUA_ENVIRONINDEX, "bundle");
+  if (lua_isnil(L, -1)) {
+    lua_pushliteral(L, "");
+    return 0;
+  }
+  path = lua_tostring(L, -1);
+  if (path == NULL)
+    luaL_error(L, LUA_QL("package.bundle") " must be a string");
+  lua_pushliteral(L, "");  /* error accumulator */
+  while ((path = pushnexttemplate(L, path)) != NULL) {
+    const char *filename = lua_tostring(L, -1);
+    Bundle *b = bundle_get(L, filename);
+    const char *bc;
+    size_t sz;
+    if (b == NULL) {
+      lua_pushfstring(L, "\n\tno bundle " LUA_QS, filename);
+    } else if ((bc = bundle_find(b, name, &sz)) != NULL) {
+      const char *chunkname = lua_pushfstring(L, "=%s", name);
+      if (luaL_loadbuffer(L, bc, sz, chunkname) != 0)
+	loaderror(L, filename);
+      return 1;  /* Module found in bundle. */
+    } else {
+      lua_pushfstring(L, "\n\tno module " LUA_QS " in bundle " LUA_QS,
+		      name, filename);
+    }
+    lua_remove(L, -2);  /* remove file name */
+    lua_concat(L, 2);  /* add entry to possible error message */
+  }
+  return 0;  /* not found */
+}
+
+/* The Lua loader checks the bundles first, so package.loaders is unchanged. */
+static int lj_cf_package_loader_lua(lua_State *L)
+{
+  const char *filename;
+  const char *name = luaL_checkstring(L, 1);
+  int msg;
+  if (bundle_load(L, name)) return 1;
+  msg = lua_gettop(L);
+  filename = findfile(L, name, "path");
+  if (filename == NULL) {  /* library not found in this path */
+    lua_pushvalue(L, msg);
+    lua_insert(L, -2);
+    lua_concat(L, 2);
+    return 1;
+  }
+  if (luaL_loadfile(L, filename) != 0)
+    loaderror(L, filename);
+  return 1;  /* library loaded successfully */
+}
+
 /* ------------------------------------------------------------------------ */
 
 static const int sentinel_ = 0;
@@ -574,6 +751,10 @@ LUALIB_API int luaopen_package(lua_State *L)
   luaL_newmetatable(L, "_LOADLIB");
   lj_lib_pushcf(L, lj_cf_package_unloadlib, 1);
   lua_setfield(L, -2, "__gc");
+  luaL_newmetatable(L, "_LOADBUNDLE");
+  lj_lib_pushcf(L, lj_cf_package_unloadbundle, 1);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
   luaL_register(L, LUA_LOADLIBNAME, package_lib);
   lua_pushvalue(L, -1);
   lua_replace(L, LUA_ENVIRONINDEX);
@@ -20,6 +20,7 @@
 #include "lj_err.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_udata.h"
 #include "lj_meta.h"
 #include "lj_state.h"
 #include "lj_ff.h"
@@ -170,9 +171,28 @@ LJLIB_CF(string_dump)
 #define CAP_UNFINISHED	(-1)
 #define CAP_POSITION	(-2)
 
+/* Compiled pattern. Cached per pattern string. */
+typedef struct PatProg {
+  uint8_t start;	/* Start filter for unanchored matches (PAT_START_*). */
+  uint8_t npfx;		/* Length of literal prefix. */
+  uint8_t first;	/* Set index+1 for PAT_START_SET. */
+  uint8_t nsets;	/* Number of character sets. */
+  uint8_t setmap[LJ_MAX_PATPROG];  /* Pattern offset -> set index+1. */
+  char pfx[LJ_MAX_PATPROG];  /* Literal prefix. */
+  uint32_t sets[LJ_MAX_PATSETS][8];  /* Character sets (variable length). */
+} PatProg;
+
+#define PAT_START_NONE	0	/* Try every position. */
+#define PAT_START_PFX	1	/* Search for literal prefix. */
+#define PAT_START_SET	2	/* Search for first char in set. */
+
+#define pat_inset(set, c)	(((set)[(c) >> 5] >> ((c) & 31)) & 1)
+
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end (`\0') of source string */
+  const char *pbase;  /* start of compiled pattern */
+  const PatProg *prog;  /* compiled pattern or NULL */
   lua_State *L;
   int level;  /* total number of captures (finished or unfinished) */
   int depth;
@@ -183,7 +203,6 @@ typedef struct MatchState {
 } MatchState;
 
 #define L_ESC		'%'
-#define SPECIALS	"^$*+?.([%-"
 
 static int check_capture(MatchState *ms, int l)
 {
@@ -276,6 +295,17 @@ static int singlematch(int c, const char *p, const char *ep)
   }
 }
 
+/* Match single char, using the precompiled set of a class, if any. */
+static LJ_AINLINE int ms_singlematch(MatchState *ms, int c,
+				     const char *p, const char *ep)
+{
+  if (ms->prog) {
+    uint32_t idx = ms->prog->setmap[p - ms->pbase];
+    if (idx) return (int)pat_inset(ms->prog->sets[idx-1], c);
+  }
+  return singlematch(c, p, ep);
+}
+
 static const char *match(MatchState *ms, const char *s, const char *p);
 
 static const char *matchbalance(MatchState *ms, const char *s, const char *p)
@@ -303,8 +333,28 @@ static const char *max_expand(MatchState *ms, const char *s,
 			      const char *p, const char *ep)
 {
   ptrdiff_t i = 0;  /* counts maximum expand for item */
-  while ((s+i)<ms->src_end && singlematch(uchar(*(s+i)), p, ep))
+  const char *np = ep+1;
+  while ((s+i)<ms->src_end && ms_singlematch(ms, uchar(*(s+i)), p, ep))
     i++;
+  if (*np == ')') {  /* Look through the end of an open capture. */
+    int l;
+    for (l = ms->level-1; l >= 0; l--)
+      if (ms->capture[l].len == CAP_UNFINISHED) break;
+    if (l >= 0) np++;
+  }
+  if (np[0] != '\0' && !strchr(LJ_STR_PATSPECIALS ")", np[0]) &&
+      (np[1] == '\0' || !strchr("*?-", np[1]))) {
+    /* Followed by a literal char, which must match. Skip to it. */
+    int c = uchar(np[0]);
+    while (i>=0) {
+      if ((s+i) < ms->src_end && uchar(*(s+i)) == c) {
+	const char *res = match(ms, (s+i), ep+1);
+	if (res) return res;
+      }
+      i--;
+    }
+    return NULL;
+  }
   /* keeps trying to match with the maximum repetitions */
   while (i>=0) {
     const char *res = match(ms, (s+i), ep+1);
@@ -321,7 +371,7 @@ static const char *min_expand(MatchState *ms, const char *s,
     const char *res = match(ms, s, ep+1);
     if (res != NULL)
       return res;
-    else if (s<ms->src_end && singlematch(uchar(*s), p, ep))
+    else if (s<ms->src_end && ms_singlematch(ms, uchar(*s), p, ep))
       s++;  /* try with one more repetition */
     else
       return NULL;
@@ -394,8 +444,8 @@ static const char *match(MatchState *ms, const char *s, const char *p)
 	lj_err_caller(ms->L, LJ_ERR_STRPATB);
       ep = classend(ms, p);  /* points to what is next */
       previous = (s == ms->src_init) ? '\0' : *(s-1);
-      if (matchbracketclass(uchar(previous), p, ep-1) ||
-	 !matchbracketclass(uchar(*s), p, ep-1)) { s = NULL; break; }
+      if (ms_singlematch(ms, uchar(previous), p, ep) ||
+	 !ms_singlematch(ms, uchar(*s), p, ep)) { s = NULL; break; }
       p=ep;
       goto init;  /* else s = match(ms, s, ep); */
       }
@@ -418,7 +468,7 @@ static const char *match(MatchState *ms, const char *s, const char *p)
     break;
   default: dflt: {  /* it is a pattern item */
     const char *ep = classend(ms, p);  /* points to what is next */
-    int m = s<ms->src_end && singlematch(uchar(*s), p, ep);
+    int m = s<ms->src_end && ms_singlematch(ms, uchar(*s), p, ep);
     switch (*ep) {
     case '?': {  /* optional */
       const char *res;
@@ -450,30 +500,170 @@ static const char *match(MatchState *ms, const char *s, const char *p)
   return s;
 }
 
-static const char *lmemfind(const char *s1, size_t l1,
-			    const char *s2, size_t l2)
+/* -- Pattern compiler ---------------------------------------------------- */
+
+/* Like classend(), but returns NULL for malformed classes. */
+static const char *pat_classend(const char *p)
 {
-  if (l2 == 0) {
-    return s1;  /* empty strings are everywhere */
-  } else if (l2 > l1) {
-    return NULL;  /* avoids a negative `l1' */
-  } else {
-    const char *init;  /* to search for a `*s2' inside `s1' */
-    l2--;  /* 1st char will be checked by `memchr' */
-    l1 = l1-l2;  /* `s2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++;   /* 1st char is already checked */
-      if (memcmp(init, s2+1, l2) == 0) {
-	return init-1;
-      } else {  /* correct `l1' and `s1' to try again */
-	l1 -= (size_t)(init-s1);
-	s1 = init;
+  switch (*p++) {
+  case L_ESC:
+    return *p == '\0' ? NULL : p+1;
+  case '[':
+    if (*p == '^') p++;
+    do {
+      if (*p == '\0') return NULL;
+      if (*(p++) == L_ESC && *p != '\0') p++;
+    } while (*p != ']');
+    return p+1;
+  default:
+    return p;
+  }
+}
+
+/* Precompute the set of chars matched by a class. */
+static int pat_addset(PatProg *pp, const char *pbase,
+		      const char *p, const char *ep)
+{
+  uint32_t *set;
+  int c;
+  if (pp->nsets >= LJ_MAX_PATSETS) return 0;
+  set = pp->sets[pp->nsets];
+  memset(set, 0, sizeof(pp->sets[0]));
+  for (c = 0; c < 256; c++)
+    if (singlematch(c, p, ep)) set[c >> 5] |= 1u << (c & 31);
+  pp->setmap[p - pbase] = ++pp->nsets;
+  return pp->nsets;
+}
+
+/* Compile pattern. Returns 0 for malformed patterns, which are left to the
+** interpreter to get the same errors at the same time.
+**
+** The compiled pattern has precomputed sets for all character classes and
+** a start filter, which is either the literal prefix of the pattern or the
+** set of chars that may start a match. The filter only describes items
+** which must match a char, so it can never skip a match (or an error).
+*/
+static int pat_compile(PatProg *pp, const char *p)
+{
+  const char *pbase = p;
+  int start = 1;  /* Still looking at the start of the pattern? */
+  memset(pp, 0, offsetof(PatProg, sets));
+  while (*p != '\0') {
+    const char *ep;
+    int c, q;
+    switch (*p) {
+    case '(':  /* Captures don't consume chars. */
+      p += (p[1] == ')') ? 2 : 1;
+      continue;
+    case ')':  /* May be an error, so stop here. */
+      start = 0; p++;
+      continue;
+    case L_ESC:
+      if (p[1] == 'b') {
+	if (p[2] == '\0' || p[3] == '\0') return 0;
+	if (start && pp->npfx == 0) pp->pfx[pp->npfx++] = p[2];
+	start = 0; p += 4;
+	continue;
+      } else if (p[1] == 'f') {
+	p += 2;
+	if (*p != '[' || !(ep = pat_classend(p))) return 0;
+	pat_addset(pp, pbase, p, ep);
+	start = 0; p = ep;
+	continue;
+      } else if (lj_char_isdigit(uchar(p[1]))) {
+	start = 0; p += 2;
+	continue;
       }
+      break;
+    case '$':
+      if (p[1] == '\0') { p++; continue; }
+      break;
+    default:
+      break;
     }
-    return NULL;  /* not found */
+    /* Single char item with optional quantifier. */
+    if (!(ep = pat_classend(p))) return 0;
+    q = *ep;
+    if (q == '?' || q == '*' || q == '+' || q == '-') ep++; else q = 0;
+    if (*p == '[' || (*p == L_ESC && lj_char_isalnum(uchar(p[1])))) {
+      int idx = pat_addset(pp, pbase, p, ep - (q != 0));
+      if (start && pp->npfx == 0 && idx && (q == 0 || q == '+')) {
+	pp->start = PAT_START_SET;
+	pp->first = (uint8_t)idx;
+      }
+      start = 0;
+    } else if (start && *p != '.' && (q == 0 || q == '+')) {
+      c = *p == L_ESC ? p[1] : *p;
+      pp->pfx[pp->npfx++] = (char)c;
+      if (q) start = 0;
+    } else {
+      start = 0;
+    }
+    p = ep;
+  }
+  if (pp->npfx) pp->start = PAT_START_PFX;
+  return 1;
+}
+
+/* Get compiled pattern from the cache or compile it. Returns NULL if the
+** pattern cannot be compiled.
+*/
+static GCudata *pat_get(lua_State *L, GCstr *pat)
+{
+  global_State *g = G(L);
+  GCtab *t = tabref(g->gcroot[GCROOT_STR_PATCACHE]);
+  GCudata *ud;
+  PatProg pp;
+  cTValue *tv;
+  if (LJ_LIKELY(t != NULL) && (tv = lj_tab_getstr(t, pat)) != NULL)
+    return tvisudata(tv) ? udataV(tv) : NULL;
+  if (pat->len >= LJ_MAX_PATPROG) return NULL;
+  if (pat_compile(&pp, strdata(pat) + (*strdata(pat) == '^'))) {
+    MSize sz = (MSize)(offsetof(PatProg, sets) + pp.nsets*sizeof(pp.sets[0]));
+    ud = lj_udata_new(L, sz, tabref(curr_func(L)->c.env));
+    memcpy(uddata(ud), &pp, sz);
+  } else {
+    ud = NULL;
+  }
+  if (t == NULL || t->hmask >= LJ_MAX_PATCACHE-1) {  /* Flush full cache. */
+    t = lj_tab_new(L, 0, 4);
+    /* NOBARRIER: The pattern cache is a GC root. */
+    setgcref(g->gcroot[GCROOT_STR_PATCACHE], obj2gco(t));
+  }
+  tv = lj_tab_setstr(L, t, pat);
+  if (ud) {
+    setudataV(L, (TValue *)tv, ud);
+    lj_gc_anybarriert(L, t);
+  } else {
+    setboolV((TValue *)tv, 0);
+  }
+  return ud;
+}
+
+/* Find next possible start of a match at or after s. */
+static const char *pat_skip(MatchState *ms, const char *s)
+{
+  const PatProg *pp = ms->prog;
+  if (pp->start == PAT_START_PFX) {
+    int32_t i = lj_str_find(s, pp->pfx, (MSize)(ms->src_end - s), pp->npfx);
+    return i >= 0 ? s+i : NULL;
+  } else {
+    const uint32_t *set = pp->sets[pp->first-1];
+    for (; s < ms->src_end; s++)
+      if (pat_inset(set, uchar(*s))) return s;
+    return NULL;
   }
 }
 
+/* Setup compiled pattern for match state. */
+static void pat_setup(MatchState *ms, GCudata *ud, const char *p)
+{
+  ms->prog = ud ? (const PatProg *)uddata(ud) : NULL;
+  ms->pbase = p;
+}
+
+/* ------------------------------------------------------------------------ */
+
 static void push_onecapture(MatchState *ms, int i, const char *s, const char *e)
 {
   if (i >= ms->level) {
@@ -525,23 +715,29 @@ static int str_find_aux(lua_State *L, int find)
 #endif
   }
   if (find && (lua_toboolean(L, 4) ||  /* explicit request? */
-      strpbrk(p, SPECIALS) == NULL)) {  /* or no special characters? */
+      !lj_str_haspattern(strV(L->base+1)))) {  /* or no special characters? */
     /* do a plain search */
-    const char *s2 = lmemfind(s+init, l1-(size_t)init, p, l2);
-    if (s2) {
-      lua_pushinteger(L, s2-s+1);
-      lua_pushinteger(L, s2-s+(ptrdiff_t)l2);
+    int32_t i = lj_str_find(s+init, p, (MSize)(l1-(size_t)init), (MSize)l2);
+    if (i >= 0) {
+      ptrdiff_t s2 = init + i;
+      lua_pushinteger(L, s2+1);
+      lua_pushinteger(L, s2+(ptrdiff_t)l2);
       return 2;
     }
   } else {
     MatchState ms;
+    GCudata *ud = pat_get(L, strV(L->base+1));
     int anchor = (*p == '^') ? (p++, 1) : 0;
     const char *s1=s+init;
     ms.L = L;
     ms.src_init = s;
     ms.src_end = s+l1;
+    pat_setup(&ms, ud, p);
     do {
       const char *res;
+      if (!anchor && ms.prog && ms.prog->start) {  /* Skip to candidate. */
+	if ((s1 = pat_skip(&ms, s1)) == NULL) break;
+      }
       ms.level = ms.depth = 0;
       if ((res=match(&ms, s1, p)) != NULL) {
 	if (find) {
@@ -558,7 +754,7 @@ static int str_find_aux(lua_State *L, int find)
   return 1;
 }
 
-LJLIB_CF(string_find)
+LJLIB_CF(string_find)		LJLIB_REC(.)
 {
   return str_find_aux(L, 1);
 }
@@ -574,13 +770,18 @@ LJLIB_NOREG LJLIB_CF(string_gmatch_aux)
   GCstr *str = strV(lj_lib_upvalue(L, 1));
   const char *s = strdata(str);
   TValue *tvpos = lj_lib_upvalue(L, 3);
+  TValue *tvprog = lj_lib_upvalue(L, 4);
   const char *src = s + tvpos->u32.lo;
   MatchState ms;
   ms.L = L;
   ms.src_init = s;
   ms.src_end = s + str->len;
+  pat_setup(&ms, tvisudata(tvprog) ? udataV(tvprog) : NULL, p);
   for (; src <= ms.src_end; src++) {
     const char *e;
+    if (ms.prog && ms.prog->start) {  /* Skip to candidate. */
+      if ((src = pat_skip(&ms, src)) == NULL) break;
+    }
     ms.level = ms.depth = 0;
     if ((e = match(&ms, src, p)) != NULL) {
       int32_t pos = (int32_t)(e - s);
@@ -594,11 +795,16 @@ LJLIB_NOREG LJLIB_CF(string_gmatch_aux)
 
 LJLIB_CF(string_gmatch)
 {
+  GCstr *p;
+  GCudata *ud;
   lj_lib_checkstr(L, 1);
-  lj_lib_checkstr(L, 2);
-  L->top = L->base+3;
-  (L->top-1)->u64 = 0;
-  lj_lib_pushcc(L, lj_cf_string_gmatch_aux, FF_string_gmatch_aux, 3);
+  p = lj_lib_checkstr(L, 2);
+  /* No anchors for gmatch. A leading '^' is matched literally. */
+  ud = *strdata(p) != '^' ? pat_get(L, p) : NULL;
+  L->top = L->base+4;
+  (L->top-2)->u64 = 0;
+  if (ud) setudataV(L, L->top-1, ud); else setnilV(L->top-1);
+  lj_lib_pushcc(L, lj_cf_string_gmatch_aux, FF_string_gmatch_aux, 4);
   return 1;
 }
 
@@ -665,16 +871,29 @@ LJLIB_CF(string_gsub)
   int anchor = (*p == '^') ? (p++, 1) : 0;
   int n = 0;
   MatchState ms;
+  GCudata *ud;
   luaL_Buffer b;
   if (!(tr == LUA_TNUMBER || tr == LUA_TSTRING ||
 	tr == LUA_TFUNCTION || tr == LUA_TTABLE))
     lj_err_arg(L, 3, LJ_ERR_NOSFT);
+  ud = pat_get(L, strV(L->base+1));
+  if (ud) {  /* Anchor it, since the replacement function may flush it. */
+    L->top = L->base+4;  /* Note: arg 4 isn't used after this. */
+    setudataV(L, L->top-1, ud);
+  }
   luaL_buffinit(L, &b);
   ms.L = L;
   ms.src_init = src;
   ms.src_end = src+srcl;
+  pat_setup(&ms, ud, p);
   while (n < max_s) {
     const char *e;
+    if (!anchor && ms.prog && ms.prog->start) {  /* Skip to candidate. */
+      const char *s1 = pat_skip(&ms, src);
+      if (s1 == NULL) break;
+      luaL_addlstring(&b, src, (size_t)(s1-src));
+      src = s1;
+    }
     ms.level = ms.depth = 0;
     e = match(&ms, src, p);
     if (e) {
@@ -767,6 +986,18 @@ static void addintlen(char *form)
   form[l + sizeof(LUA_INTFRMLEN) - 1] = '\0';
 }
 
+/* Get precision of a plain "%g", "%f", "%.<prec>g" or "%.<prec>f". */
+static int plainprec(const char *form)
+{
+  const char *p = form+1;
+  int prec = 6;
+  if (*p == '.') {
+    for (prec = 0, p++; lj_char_isdigit(uchar(*p)); p++)
+      prec = prec*10 + (*p - '0');
+  }
+  return p[1] == '\0' ? prec : -1;  /* Any flags or width? */
+}
+
 static unsigned LUA_INTFRM_T num2intfrm(lua_State *L, int arg)
 {
   if (sizeof(LUA_INTFRM_T) == 4) {
@@ -857,10 +1088,18 @@ LJLIB_CF(string_format)
       case 'c':
 	sprintf(buff, form, lj_lib_checkint(L, arg));
 	break;
-      case 'd':  case 'i':
+      case 'd':  case 'i': {
+	LUA_INTFRM_T k = (LUA_INTFRM_T)num2intfrm(L, arg);
+	if (form[2] == '\0' && (LUA_INTFRM_T)(int32_t)k == k) {
+	  /* Fast path for plain %d. */
+	  char *p = lj_str_bufint(buff, (int32_t)k);
+	  luaL_addlstring(&b, p, (size_t)(buff+LJ_STR_INTBUF-p));
+	  continue;
+	}
 	addintlen(form);
-	sprintf(buff, form, num2intfrm(L, arg));
+	sprintf(buff, form, k);
 	break;
+	}
       case 'o':  case 'u':  case 'x':  case 'X':
 	addintlen(form);
 	sprintf(buff, form, num2uintfrm(L, arg));
@@ -883,6 +1122,21 @@ LJLIB_CF(string_format)
 	  sprintf(buff, form, nbuf);
 	  break;
 	}
+	if (strfrmt[-1] == 'g' || strfrmt[-1] == 'f') {
+	  /* Fast path for plain %g, %.<prec>g, %f and %.<prec>f. */
+	  int prec = plainprec(form);
+	  size_t len = 0;
+	  if (strfrmt[-1] == 'g') {
+	    if (prec == 0) prec = 1;
+	    if (prec > 0 && prec <= 15) len = lj_str_bufnumg(buff, tv.n, prec);
+	  } else if (prec >= 0 && prec <= 22) {
+	    len = lj_str_bufnumf(buff, tv.n, prec);
+	  }
+	  if (len) {
+	    luaL_addlstring(&b, buff, len);
+	    continue;
+	  }
+	}
 	sprintf(buff, form, (double)tv.n);
 	break;
 	}
@@ -390,6 +390,13 @@
 #define LJ_HASFFI		1
 #endif
 
+/* Enable or disable address space reservation for large Lua stacks. */
+#if defined(LUAJIT_ENABLE_STACKMAP) && LJ_TARGET_POSIX && !LJ_TARGET_CONSOLE
+#define LJ_HASSTACKMAP		1
+#else
+#define LJ_HASSTACKMAP		0
+#endif
+
 #ifndef LJ_ARCH_HASFPU
 #define LJ_ARCH_HASFPU		1
 #endif
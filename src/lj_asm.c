@@ -84,6 +84,7 @@ typedef struct ASMState {
   GCtrace *parent;	/* Parent trace (or NULL). */
 
   MCode *mcbot;		/* Bottom of reserved MCode. */
+  MCode *mccold;	/* Start of cold MCode, above the exit stubs. */
   MCode *mctop;		/* Top of generated MCode. */
   MCode *mcloop;	/* Pointer to loop MCode (or NULL). */
   MCode *invmcp;	/* Points to invertible loop branch (or NULL). */
@@ -1850,9 +1851,12 @@ void lj_asm_trace(jit_State *J, GCtrace *T)
   as->mcp = as->mctop;
   as->mclim = as->mcbot + MCLIM_REDZONE;
   asm_setup_target(as);
+  as->mccold = as->mcbot;
 
   do {
     as->mcp = as->mctop;
+    as->mcbot = as->mccold;  /* Drop cold MCode of a previous try. */
+    as->mclim = as->mcbot + MCLIM_REDZONE;
 #ifdef LUA_USE_ASSERT
     as->mcp_prev = as->mcp;
 #endif
@@ -1912,7 +1916,14 @@ void lj_asm_trace(jit_State *J, GCtrace *T)
   if (!as->loopref)
     asm_tail_fixup(as, T->link);  /* Note: this may change as->mctop! */
   T->szmcode = (MSize)((char *)as->mctop - (char *)as->mcp);
+  T->szmcalloc = (MSize)((char *)origtop - (char *)as->mcp);
+  T->mccold = as->mccold;
+  T->szmccold = (MSize)((char *)as->mcbot - (char *)as->mccold);
   lj_mcode_sync(T->mcode, origtop);
+  if (T->szmccold) {
+    lj_mcode_sync(as->mccold, as->mcbot);
+    lj_mcode_commitbot(J, as->mcbot);
+  }
 }
 
 #undef IR
@@ -190,6 +190,14 @@ static void asm_fuseahuref(ASMState *as, IRRef ref, RegSet allow)
 	return;
       }
       break;
+    case IR_ADD:  /* Stack slot written back before closing upvalues. */
+      if (ir->op1 == REF_BASE && irref_isk(ir->op2)) {
+	as->mrm.base = (uint8_t)ra_alloc1(as, REF_BASE, allow);
+	as->mrm.ofs = IR(ir->op2)->i;
+	as->mrm.idx = RID_NONE;
+	return;
+      }
+      break;
     default:
       lua_assert(ir->o == IR_HREF || ir->o == IR_NEWREF || ir->o == IR_UREFO ||
 		 ir->o == IR_KKPTR);
@@ -589,6 +597,8 @@ static void asm_call(ASMState *as, IRIns *ir)
   IRRef args[CCI_NARGS_MAX];
   const CCallInfo *ci = &lj_ir_callinfo[ir->op2];
   asm_collectargs(as, ir, ci, args);
+  if ((ci->flags & CCI_ALLOC))
+    as->gcsteps++;
   asm_setupresult(as, ir, ci);
   asm_gencall(as, ci, args);
 }
@@ -1567,6 +1577,47 @@ static void asm_cnew(ASMState *as, IRIns *ir)
 #define asm_cnew(as, ir)	((void)0)
 #endif
 
+/* -- Cold code ----------------------------------------------------------- */
+
+/* Rarely taken slow paths are moved out of the trace into cold code at the
+** bottom of the reserved MCode, right above the exit stubs. Each slow path
+** gets a fixed-size slot. It's emitted backwards from the top of the slot,
+** ending with a jump back to the hot code. The hot code only keeps a branch
+** to the start of the cold code. Exits from cold code are never patched.
+*/
+
+/* Maximum size of a cold slot (incl. stray writes below the start). */
+#define COLD_MAXSZ	48
+
+/* Switch to emitting cold code. Returns the saved hot MCode pointer. */
+static MCode *asm_cold_start(ASMState *as)
+{
+  MCode *hot = as->mcp;
+  if (as->mcbot + COLD_MAXSZ + MCLIM_REDZONE > hot)
+    asm_mclimit(as);
+  as->mcp = as->mcbot + COLD_MAXSZ;
+  as->mclim = as->mcbot;  /* Limit for checkmclim() inside the slot. */
+#ifdef LUA_USE_ASSERT
+  as->mcp_prev = as->mcp;
+#endif
+  return hot;
+}
+
+/* Switch back to hot code. Returns the start of the cold code. */
+static MCode *asm_cold_end(ASMState *as, MCode *hot)
+{
+  MCode *cold = as->mcp;
+  lua_assert(cold >= as->mcbot + 4);  /* Room for stray writes. */
+  as->mcbot += COLD_MAXSZ;
+  as->mclim = as->mcbot + MCLIM_REDZONE;
+  as->mcp = hot;
+  as->flagmcp = NULL;
+#ifdef LUA_USE_ASSERT
+  as->mcp_prev = hot;
+#endif
+  return cold;
+}
+
 /* -- Write barriers ------------------------------------------------------ */
 
 static void asm_tbar(ASMState *as, IRIns *ir)
@@ -1574,12 +1625,14 @@ static void asm_tbar(ASMState *as, IRIns *ir)
   Reg tab = ra_alloc1(as, ir->op1, RSET_GPR);
   Reg tmp = ra_scratch(as, rset_exclude(RSET_GPR, tab));
   MCLabel l_end = emit_label(as);
+  MCode *hot = asm_cold_start(as);
+  emit_jmp(as, l_end);
   emit_movtomro(as, tmp, tab, offsetof(GCtab, gclist));
   emit_setgl(as, tab, gc.grayagain);
   emit_getgl(as, tmp, gc.grayagain);
   emit_i8(as, ~LJ_GC_BLACK);
   emit_rmro(as, XO_ARITHib, XOg_AND, tab, offsetof(GCtab, marked));
-  emit_sjcc(as, CC_Z, l_end);
+  emit_jcc(as, CC_NZ, asm_cold_end(as, hot));
   emit_i8(as, LJ_GC_BLACK);
   emit_rmro(as, XO_GROUP3b, XOg_TEST, tab, offsetof(GCtab, marked));
 }
@@ -1589,17 +1642,20 @@ static void asm_obar(ASMState *as, IRIns *ir)
   const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_gc_barrieruv];
   IRRef args[2];
   MCLabel l_end;
+  MCode *hot;
   Reg obj;
   /* No need for other object barriers (yet). */
   lua_assert(IR(ir->op1)->o == IR_UREFC);
   ra_evictset(as, RSET_SCRATCH);
   l_end = emit_label(as);
+  hot = asm_cold_start(as);
+  emit_jmp(as, l_end);
   args[0] = ASMREF_TMP1;  /* global_State *g */
   args[1] = ir->op1;      /* TValue *tv      */
   asm_gencall(as, ci, args);
   emit_loada(as, ra_releasetmp(as, ASMREF_TMP1), J2G(as->J));
   obj = IR(ir->op1)->r;
-  emit_sjcc(as, CC_Z, l_end);
+  emit_jcc(as, CC_NZ, asm_cold_end(as, hot));
   emit_i8(as, LJ_GC_WHITES);
   if (irref_isk(ir->op2)) {
     GCobj *vp = ir_kgc(IR(ir->op2));
@@ -2417,9 +2473,12 @@ static void asm_gc_check(ASMState *as)
   const CCallInfo *ci = &lj_ir_callinfo[IRCALL_lj_gc_step_jit];
   IRRef args[2];
   MCLabel l_end;
+  MCode *hot;
   Reg tmp;
   ra_evictset(as, RSET_SCRATCH);
   l_end = emit_label(as);
+  hot = asm_cold_start(as);
+  emit_jmp(as, l_end);
   /* Exit trace if in GCSatomic or GCSfinalize. Avoids syncing GC objects. */
   asm_guardcc(as, CC_NE);  /* Assumes asm_snap_prep() already done. */
   emit_rr(as, XO_TEST, RID_RET, RID_RET);
@@ -2429,8 +2488,8 @@ static void asm_gc_check(ASMState *as)
   tmp = ra_releasetmp(as, ASMREF_TMP1);
   emit_loada(as, tmp, J2G(as->J));
   emit_loadi(as, ra_releasetmp(as, ASMREF_TMP2), as->gcsteps);
-  /* Jump around GC step if GC total < GC threshold. */
-  emit_sjcc(as, CC_B, l_end);
+  /* Do GC step in cold code if GC total >= GC threshold. */
+  emit_jcc(as, CC_AE, asm_cold_end(as, hot));
   emit_opgl(as, XO_ARITH(XOg_CMP), tmp, gc.threshold);
   emit_getgl(as, tmp, gc.total);
   as->gcsteps = 0;
@@ -65,6 +65,9 @@ typedef unsigned int uintptr_t;
 #define LJ_MAX_UPVAL	60		/* Max. # of upvalues. */
 
 #define LJ_MAX_IDXCHAIN	100		/* __index/__newindex chain limit. */
+#define LJ_MAX_PATPROG	128		/* Max. length of compiled patterns. */
+#define LJ_MAX_PATSETS	32		/* Max. char sets per pattern. */
+#define LJ_MAX_PATCACHE	64		/* Max. # of cached patterns. */
 #define LJ_STACK_EXTRA	5		/* Extra stack space (metamethods). */
 
 #define LJ_NUM_CBPAGE	1		/* Number of FFI callback pages. */
@@ -51,8 +51,14 @@ GOTDEF(GOTENUM)
 /* 16 bits are sufficient. Only 0.0015% overhead with maximum slot penalty. */
 typedef uint16_t HotCount;
 
-/* Number of hot counter hash table entries (must be a power of two). */
+/* Number of hot counter hash table entries (must be a power of two).
+** The other VMs hardcode the mask for 64 entries in their hotcheck macros.
+*/
+#if LJ_TARGET_X86ORX64
+#define HOTCOUNT_SIZE		256
+#else
 #define HOTCOUNT_SIZE		64
+#endif
 #define HOTCOUNT_PCMASK		((HOTCOUNT_SIZE-1)*sizeof(HotCount))
 
 /* Hotcount decrements. */
@@ -57,11 +57,21 @@
 ** EXT cannot be enabled on WIN32 since system exceptions use code-driven SEH.
 ** EXT is mandatory on WIN64 since the calling convention has an abundance
 ** of callee-saved registers (rbx, rbp, rsi, rdi, r12-r15, xmm6-xmm15).
-** The POSIX/x64 interpreter only saves r12/r13 for INT (e.g. PS4).
+** The POSIX/x64 interpreter saves r12/r13, too, even though only INT
+** (e.g. PS4) strictly needs them.
+**
+** EXT on POSIX/x86/x64 has a fast path for the common case: if the error
+** is caught by a pcall() in the current C frame and no foreign C code is
+** in between, the C stack is unwound directly, like for INT. This skips
+** the expensive two-phase search of the external unwinder. It's safe,
+** because the interpreter restores all callee-saved registers on exit.
 */
 
 #if defined(__GNUC__) && (LJ_TARGET_X64 || defined(LUAJIT_UNWIND_EXTERNAL)) && !LJ_NO_UNWIND
 #define LJ_UNWIND_EXT	1
+#if LJ_TARGET_X86ORX64 && !LJ_ABI_WIN
+#define LJ_UNWIND_FAST	1
+#endif
 #elif LJ_TARGET_X64 && LJ_TARGET_WINDOWS
 #define LJ_UNWIND_EXT	1
 #endif
@@ -184,6 +194,46 @@ static void *err_unwind(lua_State *L, void *stopcf, int errcode)
   return L;  /* Anything non-NULL will do. */
 }
 
+#if LJ_UNWIND_FAST
+/* Check whether the error is caught by a pcall() in the current C frame. */
+static int err_unwind_fast(lua_State *L, int errcode)
+{
+  TValue *frame = L->base-1;
+  TValue *bot = tvref(L->stack);
+  void *cf = L->cframe;
+  TValue *top;
+  int32_t nres;
+  if (!cf || errcode == LUA_YIELD || hook_active(G(L)) || frame <= bot)
+    return 0;
+  if (frame_func(frame)->c.ffid == FF_C)
+    return 0;  /* Foreign C function may need cleanup by the unwinder. */
+  nres = cframe_nres(cframe_raw(cf));
+  top = nres < 0 ? restorestack(L, -nres) : bot;
+  while (frame >= top && frame > bot) {
+    switch (frame_typep(frame)) {
+    case FRAME_LUA:  /* Lua frame. */
+    case FRAME_LUAP:
+      frame = frame_prevl(frame);
+      break;
+    case FRAME_CONT:  /* Continuation frame. */
+#if LJ_HASFFI
+      if ((frame-1)->u32.lo == LJ_CONT_FFI_CALLBACK)
+	return 0;
+#endif
+    case FRAME_VARG:  /* Vararg frame. */
+      frame = frame_prevd(frame);
+      break;
+    case FRAME_PCALL:  /* FF pcall() frame. */
+    case FRAME_PCALLH:  /* FF pcall() frame inside hook. */
+      return 1;
+    default:  /* C frame or protected C frame. */
+      return 0;
+    }
+  }
+  return 0;
+}
+#endif
+
 /* -- External frame unwinding -------------------------------------------- */
 
 #if defined(__GNUC__) && !LJ_NO_UNWIND && !LJ_ABI_WIN
@@ -457,6 +507,10 @@ LJ_NOINLINE void LJ_FASTCALL lj_err_throw(lua_State *L, int errcode)
   setgcrefnull(g->jit_L);
   L->status = 0;
 #if LJ_UNWIND_EXT
+#if LJ_UNWIND_FAST
+  if (err_unwind_fast(L, errcode))
+    lj_vm_unwind_ff(cframe_raw(err_unwind(L, NULL, errcode)));
+#endif
   err_raise_ext(errcode);
   /*
   ** A return from this function signals a corrupt C stack that cannot be
@@ -105,20 +105,112 @@ LJ_NORET static void recff_nyiu(jit_State *J)
   lj_trace_err_info(J, LJ_TRERR_NYIFFU);
 }
 
+/* -- Trace stitching ----------------------------------------------------- */
+
+#if LJ_TARGET_X86ORX64
+/* Check whether the trace can be stitched across a call to this function. */
+static int recff_canstitch(jit_State *J)
+{
+  TValue *frame = J->L->base - 1;
+  if (J->cur.nins < (IRRef)J->param[JIT_P_minstitch] + REF_BASE)
+    return 0;  /* Too short. Better let the whole thing run interpreted. */
+  /* Can only stitch from a plain Lua call. */
+  if (J->framedepth > 0 && frame_islua(frame)) {
+    const BCIns *pc = frame_pc(frame);
+    BCOp cop = bc_op(pc[-1]), op = bc_op(*pc);
+    /* Stitched trace cannot start with *M op with variable # of args. */
+    if ((cop == BC_CALL || cop == BC_CALLM) &&
+	!(op == BC_CALLM || op == BC_CALLMT ||
+	  op == BC_RETM || op == BC_TSETM)) {
+      switch (J->fn->c.ffid) {
+      case FF_error:
+      case FF_debug_sethook:
+      case FF_jit_flush:
+	return 0;  /* Don't stitch across special builtins. */
+      default:
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* End the trace with a continuation frame below the called function.
+** The continuation starts a new trace (or links to an existing one) for
+** the bytecode following the call, once the call returns.
+*/
+static void recff_stitch(jit_State *J)
+{
+  lua_State *L = J->L;
+  TValue *base = L->base;
+  BCReg nslot = J->maxslot + 1;
+  TValue *nframe = base + 1;
+  const BCIns *pc = frame_pc(base-1);
+  TValue *pframe = frame_prevl(base-1);
+  TRef trcont;
+
+  /* Check for this now. Throwing in lj_record_stop messes up the stack. */
+  if (J->cur.nsnap >= (MSize)J->param[JIT_P_maxsnap])
+    lj_trace_err(J, LJ_TRERR_SNAPOV);
+
+  /* Move func + args up in Lua stack and insert continuation. */
+  memmove(&base[1], &base[-1], sizeof(TValue)*nslot);
+  setframe_ftsz(nframe, ((char *)nframe - (char *)pframe) + FRAME_CONT);
+  setcont(base, lj_cont_stitch);
+  setframe_pc(base, pc);
+  setnilV(base-1);  /* Incorrect, but rec_check_slots() won't run anymore. */
+  L->base += 2;
+  L->top += 2;
+
+  /* Ditto for the IR. The previous trace number is kept below the frame. */
+  memmove(&J->base[1], &J->base[-1], sizeof(TRef)*nslot);
+#if LJ_64
+  trcont = lj_ir_kptr(J, (void *)((int64_t)lj_cont_stitch -
+				  (int64_t)lj_vm_asm_begin));
+#else
+  trcont = lj_ir_kptr(J, (void *)lj_cont_stitch);
+#endif
+  J->base[0] = trcont | TREF_CONT;
+  J->base[-1] = lj_ir_knum(J, (lua_Number)J->cur.traceno);
+  J->base += 2;
+  J->baseslot += 2;
+  J->framedepth++;
+
+  lj_record_stop(J, LJ_TRLINK_STITCH, 0);
+
+  /* Undo Lua stack changes. */
+  memmove(&base[-1], &base[1], sizeof(TValue)*nslot);
+  setframe_pc(base-1, pc);
+  L->base -= 2;
+  L->top -= 2;
+}
+#else
+#define recff_canstitch(J)	0  /* NYI: trace stitching for other VMs. */
+#define recff_stitch(J)		UNUSED(J)
+#endif
+
 /* Fallback handler for all fast functions that are not recorded (yet). */
 static void LJ_FASTCALL recff_nyi(jit_State *J, RecordFFData *rd)
 {
+  if (recff_canstitch(J)) {
+    recff_stitch(J);  /* Use trace stitching. */
+    rd->nres = -1;
+    return;
+  }
   setfuncV(J->L, &J->errinfo, J->fn);
   lj_trace_err_info(J, LJ_TRERR_NYIFF);
-  UNUSED(rd);
 }
 
 /* C functions can have arbitrary side-effects and are not recorded (yet). */
 static void LJ_FASTCALL recff_c(jit_State *J, RecordFFData *rd)
 {
+  if (recff_canstitch(J)) {
+    recff_stitch(J);  /* Use trace stitching. */
+    rd->nres = -1;
+    return;
+  }
   setfuncV(J->L, &J->errinfo, J->fn);
   lj_trace_err_info(J, LJ_TRERR_NYICF);
-  UNUSED(rd);
 }
 
 /* -- Base library fast functions ----------------------------------------- */
@@ -733,6 +825,80 @@ static void LJ_FASTCALL recff_string_range(jit_State *J, RecordFFData *rd)
   }
 }
 
+/* Record string.find() for fixed strings. */
+static void LJ_FASTCALL recff_string_find(jit_State *J, RecordFFData *rd)
+{
+  TRef trstr, trpat, trlen, trplen, trstart, tr, tr0 = lj_ir_kint(J, 0);
+  GCstr *str, *pat;
+  int32_t start, pos;
+  int plain = J->base[2] && tref_istruecond(J->base[3]);
+  if (!plain && !(tref_isstr(J->base[1]) &&
+		  !lj_str_haspattern(strV(&rd->argv[1])))) {
+    recff_c(J, rd);  /* NYI: pattern matching. */
+    return;
+  }
+  trstr = lj_ir_tostr(J, J->base[0]);
+  trpat = lj_ir_tostr(J, J->base[1]);
+  str = argv2str(J, &rd->argv[0]);
+  pat = argv2str(J, &rd->argv[1]);
+  if (!plain)  /* Specialize to pattern without pattern matching chars. */
+    emitir(IRTG(IR_EQ, IRT_STR), trpat, lj_ir_kstr(J, pat));
+  trlen = emitir(IRTI(IR_FLOAD), trstr, IRFL_STR_LEN);
+  if (tref_isnil(J->base[2])) {
+    start = 1;
+    trstart = lj_ir_kint(J, 1);
+  } else {
+    start = argv2int(J, &rd->argv[2]);
+    trstart = lj_opt_narrow_toint(J, J->base[2]);
+  }
+  if (start < 0) {
+    emitir(IRTGI(IR_LT), trstart, tr0);
+    trstart = emitir(IRTI(IR_ADD), trlen, trstart);
+    start = start+(int32_t)str->len;
+    emitir(start < 0 ? IRTGI(IR_LT) : IRTGI(IR_GE), trstart, tr0);
+    if (start < 0) {
+      trstart = tr0;
+      start = 0;
+    }
+  } else if (start == 0) {
+    emitir(IRTGI(IR_EQ), trstart, tr0);
+    trstart = tr0;
+  } else {
+    trstart = emitir(IRTI(IR_ADD), trstart, lj_ir_kint(J, -1));
+    emitir(IRTGI(IR_GE), trstart, tr0);
+    start--;
+  }
+  if ((MSize)start <= str->len) {
+    emitir(IRTGI(IR_ULE), trstart, trlen);
+  } else {
+    emitir(IRTGI(IR_UGT), trstart, trlen);
+#if LJ_52
+    J->base[0] = TREF_NIL;
+    return;
+#else
+    trstart = trlen;
+    start = (int32_t)str->len;
+#endif
+  }
+  trplen = emitir(IRTI(IR_FLOAD), trpat, IRFL_STR_LEN);
+  tr = lj_ir_call(J, IRCALL_lj_str_find,
+		  emitir(IRT(IR_STRREF, IRT_P32), trstr, trstart),
+		  emitir(IRT(IR_STRREF, IRT_P32), trpat, tr0),
+		  emitir(IRTI(IR_SUB), trlen, trstart), trplen);
+  pos = lj_str_find(strdata(str)+start, strdata(pat),
+		    str->len-(MSize)start, pat->len);
+  if (pos >= 0) {
+    emitir(IRTGI(IR_GE), tr, tr0);
+    tr = emitir(IRTI(IR_ADD), tr, trstart);
+    J->base[0] = emitir(IRTI(IR_ADD), tr, lj_ir_kint(J, 1));
+    J->base[1] = emitir(IRTI(IR_ADD), tr, trplen);
+    rd->nres = 2;
+  } else {
+    emitir(IRTGI(IR_LT), tr, tr0);
+    J->base[0] = TREF_NIL;
+  }
+}
+
 /* -- Table library fast functions ---------------------------------------- */
 
 static void LJ_FASTCALL recff_table_getn(jit_State *J, RecordFFData *rd)
@@ -86,11 +86,7 @@ enum {
 #define CFRAME_OFS_ERRF		(5*4)
 #define CFRAME_OFS_NRES		(4*4)
 #define CFRAME_OFS_MULTRES	(1*4)
-#if LJ_NO_UNWIND
 #define CFRAME_SIZE		(12*8)
-#else
-#define CFRAME_SIZE		(10*8)
-#endif
 #define CFRAME_SIZE_JIT		(CFRAME_SIZE + 16)
 #define CFRAME_SHIFT_MULTRES	0
 #endif
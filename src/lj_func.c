@@ -149,19 +149,14 @@ GCfunc *lj_func_newL_empty(lua_State *L, GCproto *pt, GCtab *env)
   return fn;
 }
 
-/* Do a GC check and create a new Lua function with inherited upvalues. */
-GCfunc *lj_func_newL_gc(lua_State *L, GCproto *pt, GCfuncL *parent)
+/* Create a new Lua function with inherited upvalues. */
+static GCfunc *func_newL_uv(lua_State *L, GCproto *pt, GCfuncL *parent,
+			    TValue *base)
 {
-  GCfunc *fn;
-  GCRef *puv;
-  MSize i, nuv;
-  TValue *base;
-  lj_gc_check_fixtop(L);
-  fn = func_newL(L, pt, tabref(parent->env));
+  GCfunc *fn = func_newL(L, pt, tabref(parent->env));
+  GCRef *puv = parent->uvptr;
+  MSize i, nuv = pt->sizeuv;
   /* NOBARRIER: The GCfunc is new (marked white). */
-  puv = parent->uvptr;
-  nuv = pt->sizeuv;
-  base = L->base;
   for (i = 0; i < nuv; i++) {
     uint32_t v = proto_uv(pt)[i];
     GCupval *uv;
@@ -178,6 +173,24 @@ GCfunc *lj_func_newL_gc(lua_State *L, GCproto *pt, GCfuncL *parent)
   return fn;
 }
 
+/* Do a GC check and create a new Lua function with inherited upvalues. */
+GCfunc *lj_func_newL_gc(lua_State *L, GCproto *pt, GCfuncL *parent)
+{
+  lj_gc_check_fixtop(L);
+  return func_newL_uv(L, pt, parent, L->base);
+}
+
+#if LJ_HASJIT
+/* Create a new Lua function from a trace. The GC check is done by the trace.
+** The base of the frame is passed explicitly, since L->base is not in sync.
+*/
+GCfunc *lj_func_newL_jit(lua_State *L, GCproto *pt, GCfuncL *parent,
+			 TValue *base)
+{
+  return func_newL_uv(L, pt, parent, base);
+}
+#endif
+
 void LJ_FASTCALL lj_func_free(global_State *g, GCfunc *fn)
 {
   MSize size = isluafunc(fn) ? sizeLfunc((MSize)fn->l.nupvalues) :
@@ -17,6 +17,7 @@
 #include "lj_gc.h"
 #include "lj_str.h"
 #include "lj_tab.h"
+#include "lj_func.h"
 #include "lj_ir.h"
 #include "lj_jit.h"
 #include "lj_ircall.h"
@@ -36,6 +36,7 @@ typedef struct CCallInfo {
 #define CCI_CASTU64		0x0200	/* Cast u64 result to number. */
 #define CCI_NOFPRCLOBBER	0x0400	/* Does not clobber any FPRs. */
 #define CCI_VARARG		0x0800	/* Vararg function. */
+#define CCI_ALLOC		0x4000	/* Allocates a GC object. */
 
 #define CCI_CC_MASK		0x3000	/* Calling convention mask. */
 #define CCI_CC_SHIFT		12
@@ -101,6 +102,7 @@ typedef struct CCallInfo {
 /* Function definitions for CALL* instructions. */
 #define IRCALLDEF(_) \
   _(ANY,	lj_str_cmp,		2,  FN, INT, CCI_NOFPRCLOBBER) \
+  _(ANY,	lj_str_find,		4,   N, INT, 0) \
   _(ANY,	lj_str_new,		3,   S, STR, CCI_L) \
   _(ANY,	lj_strscan_num,		2,  FN, INT, 0) \
   _(ANY,	lj_str_fromint,		2,  FN, STR, CCI_L) \
@@ -112,6 +114,8 @@ typedef struct CCallInfo {
   _(ANY,	lj_gc_step_jit,		2,  FS, NIL, CCI_L) \
   _(ANY,	lj_gc_barrieruv,	2,  FS, NIL, 0) \
   _(ANY,	lj_mem_newgco,		2,  FS, P32, CCI_L) \
+  _(ANY,	lj_func_newL_jit,	4,   S, FUNC, CCI_L|CCI_ALLOC) \
+  _(ANY,	lj_func_closeuv,	2,  FS, NIL, CCI_L) \
   _(ANY,	lj_math_random_step, 1, FS, NUM, CCI_CASTU64) \
   _(ANY,	lj_vm_modi,		2,  FN, INT, 0) \
   _(ANY,	sinh,			ARG1_FP,  N, NUM, 0) \
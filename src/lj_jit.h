@@ -104,6 +104,8 @@
   _(\007, hotloop,	56)	/* # of iter. to detect a hot loop/call. */ \
   _(\007, hotexit,	10)	/* # of taken exits to start a side trace. */ \
   _(\007, tryside,	4)	/* # of attempts to compile a side trace. */ \
+  _(\007, backoff,	1)	/* Log2 backoff after failed side traces. */ \
+  _(\011, minstitch,	0)	/* Min. # of IR ins for a stitched trace. */ \
   \
   _(\012, instunroll,	4)	/* Max. unroll for instable loops. */ \
   _(\012, loopunroll,	15)	/* Max. unroll for loop ops in side traces. */ \
@@ -161,6 +163,14 @@ typedef struct MCLink {
   size_t size;		/* Size of current area. */
 } MCLink;
 
+/* Free block of reclaimed machine code in an MCode area. */
+typedef struct MCFree {
+  MCode *mcode;		/* Start of free block. */
+  size_t size;		/* Size of free block. */
+} MCFree;
+
+#define MCFREE_SLOTS	64	/* Number of free block slots. */
+
 /* Stack snapshot header. */
 typedef struct SnapShot {
   uint16_t mapofs;	/* Offset into snapshot map. */
@@ -180,6 +190,9 @@ typedef uint32_t SnapEntry;
 #define SNAP_CONT		0x020000	/* Continuation slot. */
 #define SNAP_NORESTORE		0x040000	/* No need to restore slot. */
 #define SNAP_SOFTFPNUM		0x080000	/* Soft-float number. */
+#define SNAP_DELTA		0x100000	/* Delta map header (saved trace). */
+#define SNAP_SAMELINKS		0x200000	/* Delta map keeps frame links. */
+#define SNAP_KILL		0x400000	/* Slot removed by delta map. */
 LJ_STATIC_ASSERT(SNAP_FRAME == TREF_FRAME);
 LJ_STATIC_ASSERT(SNAP_CONT == TREF_CONT);
 
@@ -211,7 +224,8 @@ typedef enum {
   LJ_TRLINK_UPREC,		/* Up-recursion. */
   LJ_TRLINK_DOWNREC,		/* Down-recursion. */
   LJ_TRLINK_INTERP,		/* Fallback to interpreter. */
-  LJ_TRLINK_RETURN		/* Return to interpreter. */
+  LJ_TRLINK_RETURN,		/* Return to interpreter. */
+  LJ_TRLINK_STITCH		/* Trace stitching. */
 } TraceLink;
 
 /* Trace object. */
@@ -233,6 +247,9 @@ typedef struct GCtrace {
   MSize szmcode;	/* Size of machine code. */
   MCode *mcode;		/* Start of machine code. */
   MSize mcloop;		/* Offset of loop start in machine code. */
+  MSize szmcalloc;	/* Size of allocated machine code incl. stubs. */
+  MCode *mccold;	/* Start of cold machine code. */
+  MSize szmccold;	/* Size of cold machine code. */
   uint16_t nchild;	/* Number of child traces (root trace only). */
   uint16_t spadjust;	/* Stack pointer adjustment (offset in bytes). */
   TraceNo1 traceno;	/* Trace number. */
@@ -404,6 +421,9 @@ typedef struct jit_State {
   MCode *mcbot;		/* Bottom of current mcode area. */
   size_t szmcarea;	/* Size of current mcode area. */
   size_t szallmcarea;	/* Total size of all allocated mcode areas. */
+  MCFree mcfree[MCFREE_SLOTS];  /* Free blocks of reclaimed machine code. */
+  uint32_t nmcfree;	/* Number of free blocks. */
+  size_t szmcfree;	/* Total size of all free blocks. */
 
   TValue errinfo;	/* Additional info element for trace errors. */
 }
@@ -72,6 +72,30 @@ static LJ_AINLINE void save(LexState *ls, int c)
     ls->sb.buf[ls->sb.n++] = (char)c;
 }
 
+static LJ_NOINLINE void save_growrun(LexState *ls, MSize len)
+{
+  MSize newsize = ls->sb.sz;
+  if (ls->sb.n + len >= LJ_MAX_STR/2)
+    lj_lex_error(ls, 0, LJ_ERR_XELEM);
+  while (ls->sb.n + len > newsize) newsize *= 2;
+  lj_str_resizebuf(ls->L, &ls->sb, newsize);
+}
+
+/* Save the current char plus a run of chars from the input buffer. */
+static LJ_AINLINE void save_run(LexState *ls, const char *q)
+{
+  MSize len = (MSize)(q - ls->p);
+  if (LJ_UNLIKELY(ls->sb.n + len + 1 > ls->sb.sz))
+    save_growrun(ls, len + 1);
+  ls->sb.buf[ls->sb.n++] = (char)ls->current;
+  memcpy(ls->sb.buf + ls->sb.n, ls->p, len);
+  ls->sb.n += len;
+}
+
+/* Skip a run of chars from the input buffer and get the next char. */
+#define skip_run(ls, q) \
+  (ls->n -= (MSize)((q) - ls->p), ls->p = (q), next(ls))
+
 static void inclinenumber(LexState *ls)
 {
   int old = ls->current;
@@ -169,10 +193,15 @@ static void read_long_string(LexState *ls, TValue *tv, int sep)
       inclinenumber(ls);
       if (!tv) lj_str_resetbuf(&ls->sb);  /* avoid wasting space */
       break;
-    default:
-      if (tv) save_and_next(ls);
-      else next(ls);
+    default: {
+      /* Bulk scan up to the next char which needs special handling. */
+      const char *q = ls->p, *e = q + ls->n;
+      while (q < e && *q != ']' && *q != '\n' && *q != '\r')
+	q++;
+      if (tv) save_run(ls, q);
+      skip_run(ls, q);
       break;
+      }
     }
   } endloop:
   if (tv) {
@@ -246,9 +275,16 @@ static void read_string(LexState *ls, int delim, TValue *tv)
       next(ls);
       continue;
       }
-    default:
-      save_and_next(ls);
+    default: {
+      /* Bulk scan up to the next char which needs special handling. */
+      const char *q = ls->p, *e = q + ls->n;
+      while (q < e && *q != delim && *q != '\\' &&
+	     *q != '\n' && *q != '\r')
+	q++;
+      save_run(ls, q);
+      skip_run(ls, q);
       break;
+      }
     }
   }
   save_and_next(ls);  /* skip delimiter */
@@ -269,7 +305,10 @@ static int llex(LexState *ls, TValue *tv)
       }
       /* Identifier or reserved word. */
       do {
-	save_and_next(ls);
+	const char *q = ls->p, *e = q + ls->n;
+	while (q < e && lj_char_isident(char2int(*q))) q++;
+	save_run(ls, q);
+	skip_run(ls, q);
       } while (lj_char_isident(ls->current));
       s = lj_parse_keepstr(ls, ls->sb.buf, ls->sb.n);
       setstrV(ls->L, tv, s);
@@ -285,9 +324,12 @@ static int llex(LexState *ls, TValue *tv)
     case ' ':
     case '\t':
     case '\v':
-    case '\f':
-      next(ls);
+    case '\f': {
+      const char *q = ls->p, *e = q + ls->n;
+      while (q < e && (*q == ' ' || *q == '\t')) q++;
+      skip_run(ls, q);
       continue;
+      }
     case '-':
       next(ls);
       if (ls->current != '-') return '-';
@@ -303,8 +345,11 @@ static int llex(LexState *ls, TValue *tv)
 	}
       }
       /* else short comment */
-      while (!currIsNewline(ls) && ls->current != END_OF_STREAM)
-	next(ls);
+      while (!currIsNewline(ls) && ls->current != END_OF_STREAM) {
+	const char *q = ls->p, *e = q + ls->n;
+	while (q < e && *q != '\n' && *q != '\r') q++;
+	skip_run(ls, q);
+      }
       continue;
     case '[': {
       int sep = skip_sep(ls);
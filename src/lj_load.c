@@ -35,6 +35,10 @@ static TValue *cpparser(lua_State *L, lua_CFunction dummy, void *ud)
   cframe_errfunc(L->cframe) = -1;  /* Inherit error function. */
   bc = lj_lex_setup(L, ls);
   if (ls->mode && !strchr(ls->mode, bc ? 'b' : 't')) {
+    if (!bc && strchr(ls->mode, 'd')) {  /* Load source text as data. */
+      lj_parse_data(ls);
+      return NULL;
+    }
     setstrV(L, L->top++, lj_err_str(L, LJ_ERR_XMODE));
     lj_err_throw(L, LUA_ERRSYNTAX);
   }
@@ -270,6 +270,104 @@ static void *mcode_alloc(jit_State *J, size_t sz)
 
 #endif
 
+/* -- MCode free blocks --------------------------------------------------- */
+
+/* Add a free block. Coalesce with adjacent free blocks and current area. */
+static void mcode_addfree(jit_State *J, MCode *p, size_t sz)
+{
+  uint32_t i;
+  for (i = 0; i < J->nmcfree; ) {
+    MCFree *f = &J->mcfree[i];
+    if ((char *)f->mcode + f->size == (char *)p) {
+      p = f->mcode;
+    } else if ((char *)p + sz != (char *)f->mcode) {
+      i++;
+      continue;
+    }
+    sz += f->size;
+    J->szmcfree -= f->size;
+    *f = J->mcfree[--J->nmcfree];  /* Remove merged block. */
+  }
+  if (sz == 0) {
+    return;
+  } else if (p == J->mctop) {  /* Grow current area downwards. */
+    J->mctop = (MCode *)((char *)p + sz);
+    return;
+  } else if ((char *)p + sz == (char *)J->mcbot) {  /* Or upwards. */
+    J->mcbot = p;
+    return;
+  }
+  if (J->nmcfree == MCFREE_SLOTS) {  /* Full? Replace smallest block. */
+    MCFree *fmin = &J->mcfree[0];
+    for (i = 1; i < MCFREE_SLOTS; i++)
+      if (J->mcfree[i].size < fmin->size) fmin = &J->mcfree[i];
+    if (fmin->size >= sz)
+      return;  /* Lost until the next flush. */
+    J->szmcfree -= fmin->size;
+    *fmin = J->mcfree[--J->nmcfree];
+  }
+  J->mcfree[J->nmcfree].mcode = p;
+  J->mcfree[J->nmcfree].size = sz;
+  J->nmcfree++;
+  J->szmcfree += sz;
+}
+
+/* Change the link to the next MCode area. Area must not be in use. */
+static void mcode_setnext(jit_State *J, MCode *mc, MCode *next)
+{
+#ifdef LUAJIT_UNPROTECT_MCODE
+  UNUSED(J);
+  ((MCLink *)mc)->next = next;
+#else
+  size_t sz = ((MCLink *)mc)->size;
+  if (LJ_UNLIKELY(mcode_setprot(mc, sz, MCPROT_GEN)))
+    mcode_protfail(J);
+  ((MCLink *)mc)->next = next;
+  if (LJ_UNLIKELY(mcode_setprot(mc, sz, MCPROT_RUN)))
+    mcode_protfail(J);
+#endif
+}
+
+/* Make the largest free block the current area, if it's bigger. */
+static void mcode_usefree(jit_State *J)
+{
+  MCFree *f = NULL;
+  uint32_t i;
+  size_t sz = (size_t)((char *)J->mctop - (char *)J->mcbot);
+  for (i = 0; i < J->nmcfree; i++)
+    if (J->mcfree[i].size > sz) sz = J->mcfree[i].size, f = &J->mcfree[i];
+  if (f) {
+    MCode *p = f->mcode, *mc = J->mcarea;
+    J->szmcfree -= sz;
+    *f = J->mcfree[--J->nmcfree];
+    mcode_protect(J, MCPROT_RUN);
+    /* Move the MCode area holding the block to the front of the list. */
+    if (!(p >= mc && p < (MCode *)((char *)mc + J->szmcarea))) {
+      MCode *prev;
+      do {
+	prev = mc;
+	mc = ((MCLink *)prev)->next;
+	lua_assert(mc != NULL);
+      } while (!(p >= mc && p < (MCode *)((char *)mc + ((MCLink *)mc)->size)));
+      mcode_setnext(J, prev, ((MCLink *)mc)->next);
+      mcode_setnext(J, mc, J->mcarea);
+      J->mcarea = mc;
+      J->szmcarea = ((MCLink *)mc)->size;
+    }
+    /* Keep the rest of the old current area. */
+    mcode_addfree(J, J->mcbot, (size_t)((char *)J->mctop - (char *)J->mcbot));
+    J->mcbot = p;
+    J->mctop = (MCode *)((char *)p + sz);
+  }
+}
+
+/* Release the machine code of a trace. */
+void lj_mcode_release(jit_State *J, MCode *p, size_t sz)
+{
+  lua_assert(J->mcarea != NULL);
+  mcode_addfree(J, p, sz);
+}
+
 /* -- MCode area management ----------------------------------------------- */
 
 /* Allocate a new MCode area. */
@@ -278,6 +376,8 @@ static void mcode_allocarea(jit_State *J)
   MCode *oldarea = J->mcarea;
   size_t sz = (size_t)J->param[JIT_P_sizemcode] << 10;
   sz = (sz + LJ_PAGESIZE-1) & ~(size_t)(LJ_PAGESIZE - 1);
+  if (oldarea)  /* Keep the rest of the old current area. */
+    mcode_addfree(J, J->mcbot, (size_t)((char *)J->mctop - (char *)J->mcbot));
   J->mcarea = (MCode *)mcode_alloc(J, sz);
   J->szmcarea = sz;
   J->mcprot = MCPROT_GEN;
@@ -294,6 +394,8 @@ void lj_mcode_free(jit_State *J)
   MCode *mc = J->mcarea;
   J->mcarea = NULL;
   J->szallmcarea = 0;
+  J->nmcfree = 0;
+  J->szmcfree = 0;
   while (mc) {
     MCode *next = ((MCLink *)mc)->next;
     mcode_free(J, mc, ((MCLink *)mc)->size);
@@ -306,10 +408,13 @@ void lj_mcode_free(jit_State *J)
 /* Reserve the remainder of the current MCode area. */
 MCode *lj_mcode_reserve(jit_State *J, MCode **lim)
 {
-  if (!J->mcarea)
+  if (!J->mcarea) {
     mcode_allocarea(J);
-  else
+  } else {
+    if (J->nmcfree)
+      mcode_usefree(J);
     mcode_protect(J, MCPROT_GEN);
+  }
   *lim = J->mcbot;
   return J->mctop;
 }
@@ -17,6 +17,7 @@ LJ_FUNC void lj_mcode_sync(void *start, void *end);
 #include "lj_jit.h"
 
 LJ_FUNC void lj_mcode_free(jit_State *J);
+LJ_FUNC void lj_mcode_release(jit_State *J, MCode *p, size_t sz);
 LJ_FUNC MCode *lj_mcode_reserve(jit_State *J, MCode **lim);
 LJ_FUNC void lj_mcode_commit(jit_State *J, MCode *m);
 LJ_FUNC void lj_mcode_abort(jit_State *J);
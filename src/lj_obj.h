@@ -253,6 +253,7 @@ enum {
   UDTYPE_USERDATA,	/* Regular userdata. */
   UDTYPE_IO_FILE,	/* I/O library FILE. */
   UDTYPE_FFI_CLIB,	/* FFI C library namespace. */
+  UDTYPE_IO_MMAP,	/* I/O library memory-mapped file. */
   UDTYPE__MAX
 };
 
@@ -481,6 +482,7 @@ typedef enum {
   GCROOT_BASEMT_NUM = GCROOT_BASEMT + ~LJ_TNUMX,
   GCROOT_IO_INPUT,	/* Userdata for default I/O input file. */
   GCROOT_IO_OUTPUT,	/* Userdata for default I/O output file. */
+  GCROOT_STR_PATCACHE,	/* Table with compiled string patterns. */
   GCROOT_MAX
 } GCRootID;
 
@@ -509,6 +511,15 @@ typedef struct GCState {
 } GCState;
 
 /* Global state, shared by all threads of a Lua universe. */
+/* Pool of recycled coroutines. */
+typedef struct ThreadPool {
+  GCRef list;		/* Free list of lua_States, chained by nextgc. */
+  MSize num;		/* Number of lua_States in the free list. */
+  MSize max;		/* Max. number of lua_States kept in the free list. */
+  MSize reused;		/* Number of lua_States taken from the free list. */
+  MSize created;	/* Number of newly allocated lua_States. */
+} ThreadPool;
+
 typedef struct global_State {
   GCRef *strhash;	/* String hash table (hash chain anchors). */
   MSize strmask;	/* String hash mask (size of hash table - 1). */
@@ -539,6 +550,10 @@ typedef struct global_State {
   MRef jit_base;	/* Current JIT code L->base. */
   MRef ctype_state;	/* Pointer to C type state. */
   GCRef gcroot[GCROOT_MAX];  /* GC roots. */
+  ThreadPool thpool;	/* Pool of recycled coroutines. */
+#if LJ_HASSTACKMAP
+  MSize stackmapnum;	/* Number of reserved stack mappings. */
+#endif
 } global_State;
 
 #define mainthread(g)	(&gcref(g->mainthref)->th)
@@ -577,6 +592,9 @@ struct lua_State {
   GCRef env;		/* Thread environment (table of globals). */
   void *cframe;		/* End of C stack frame chain. */
   MSize stacksize;	/* True stack size (incl. LJ_STACK_EXTRA). */
+#if LJ_HASSTACKMAP
+  MSize stackmap;	/* Size of reserved stack mapping or 0 for heap. */
+#endif
 };
 
 #define G(L)			(mref(L->glref, global_State))
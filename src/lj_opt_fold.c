@@ -18,6 +18,7 @@
 #include "lj_tab.h"
 #include "lj_ir.h"
 #include "lj_jit.h"
+#include "lj_ircall.h"
 #include "lj_iropt.h"
 #include "lj_trace.h"
 #if LJ_HASFFI
@@ -153,6 +154,19 @@ typedef IRRef (LJ_FASTCALL *FoldFunc)(jit_State *J);
 /* Barrier to prevent using operands across PHIs. */
 #define PHIBARRIER(ir)	if (irt_isphi((ir)->t)) return NEXTFOLD
 
+/* Check for a call to an allocating function, e.g. closure creation. */
+static int gcstep_call(jit_State *J)
+{
+  IRRef ref = J->chain[IR_CALLS];
+  while (ref) {
+    IRIns *ir = IR(ref);
+    if ((lj_ir_callinfo[ir->op2].flags & CCI_ALLOC))
+      return 1;
+    ref = ir->prev;
+  }
+  return 0;
+}
+
 /* Barrier to prevent folding across a GC step.
 ** GC steps can only happen at the head of a trace and at LOOP.
 ** And the GC is only driven forward if there is at least one allocation.
@@ -161,7 +175,8 @@ typedef IRRef (LJ_FASTCALL *FoldFunc)(jit_State *J);
   ((ref) < J->chain[IR_LOOP] && \
    (J->chain[IR_SNEW] || J->chain[IR_XSNEW] || \
     J->chain[IR_TNEW] || J->chain[IR_TDUP] || \
-    J->chain[IR_CNEW] || J->chain[IR_CNEWI] || J->chain[IR_TOSTR]))
+    J->chain[IR_CNEW] || J->chain[IR_CNEWI] || J->chain[IR_TOSTR] || \
+    gcstep_call(J)))
 
 /* -- Constant folding for FP numbers ------------------------------------- */
 
@@ -1707,8 +1722,17 @@ LJFOLDF(abc_invar)
 {
   /* Invariant ABC marked as PTR. Drop if op1 is invariant, too. */
   if (!irt_isint(fins->t) && fins->op1 < J->chain[IR_LOOP] &&
-      !irt_isphi(IR(fins->op1)->t))
+      !irt_isphi(IR(fins->op1)->t)) {
+    /* But keep it, if the offset to the loop index is variant, too. */
+    if (fright->o == IR_ADD || fright->o == IR_ADDOV ||
+	fright->o == IR_SUB || fright->o == IR_SUBOV) {
+      IRRef lim = J->chain[IR_LOOP];
+      if ((fright->op1 > lim || irt_isphi(IR(fright->op1)->t)) &&
+	  (fright->op2 > lim || irt_isphi(IR(fright->op2)->t)))
+	return NEXTFOLD;
+    }
     return DROPFOLD;
+  }
   return NEXTFOLD;
 }
 
@@ -781,6 +781,40 @@ static int foldarith(BinOpr opr, ExpDesc *e1, ExpDesc *e2)
   return 1;
 }
 
+#ifndef LUAJIT_DISABLE_PARSEOPT
+/* Try constant-folding of comparison operators. */
+static int foldcomp(BinOpr opr, ExpDesc *e1, ExpDesc *e2)
+{
+  int res;
+  if (!expr_isk_nojump(e1) || !expr_isk_nojump(e2)) return 0;
+  if (opr == OPR_EQ || opr == OPR_NE) {
+    if (e1->k != e2->k)
+      res = 0;
+    else if (expr_isnumk(e1))
+      res = (expr_numberV(e1) == expr_numberV(e2));
+    else if (expr_isstrk(e1))
+      res = (e1->u.sval == e2->u.sval);  /* Strings are interned. */
+    else
+      res = 1;  /* Same primitive value. */
+    if (opr == OPR_NE) res = !res;
+  } else if (expr_isnumk(e1) && expr_isnumk(e2)) {
+    lua_Number n1 = expr_numberV(e1), n2 = expr_numberV(e2);
+    switch (opr) {
+    case OPR_LT: res = (n1 < n2); break;
+    case OPR_GE: res = (n1 >= n2); break;
+    case OPR_LE: res = (n1 <= n2); break;
+    default: res = (n1 > n2); break;
+    }
+  } else {
+    return 0;
+  }
+  expr_init(e1, res ? VKTRUE : VKFALSE, 0);
+  return 1;
+}
+#else
+#define foldcomp(opr, e1, e2)	0
+#endif
+
 /* Emit arithmetic operator. */
 static void bcemit_arith(FuncState *fs, BinOpr opr, ExpDesc *e1, ExpDesc *e2)
 {
@@ -912,7 +946,8 @@ static void bcemit_binop(FuncState *fs, BinOpr op, ExpDesc *e1, ExpDesc *e2)
   } else {
     lua_assert(op == OPR_NE || op == OPR_EQ ||
 	       op == OPR_LT || op == OPR_GE || op == OPR_LE || op == OPR_GT);
-    bcemit_comp(fs, op, e1, e2);
+    if (!foldcomp(op, e1, e2))
+      bcemit_comp(fs, op, e1, e2);
   }
 }
 
@@ -1300,6 +1335,45 @@ static void fscope_uvmark(FuncState *fs, BCReg level)
     bl->flags |= FSCOPE_UPVAL;
 }
 
+/* -- Dead code elimination ----------------------------------------------- */
+
+/* Emitter state at the start of code which is known to be unreachable. */
+typedef struct DeadCode {
+  BCPos pc;		/* First instruction of unreachable code. */
+  MSize vtop;		/* Top of variable stack at the start. */
+} DeadCode;
+
+#ifndef LUAJIT_DISABLE_PARSEOPT
+
+/* Start of unreachable code. */
+static void dead_begin(FuncState *fs, DeadCode *dc)
+{
+  /* Resolve pending jumps now. The target is the same, even if dropped. */
+  jmp_patchval(fs, fs->jpc, fs->pc, NO_REG, fs->pc);
+  fs->jpc = NO_JMP;
+  dc->pc = fs->lasttarget = fs->pc;  /* Don't merge with previous ins. */
+  dc->vtop = fs->ls->vtop;
+}
+
+/* End of unreachable code. Drop it, unless a goto or break escapes it. */
+static int dead_end(FuncState *fs, DeadCode *dc)
+{
+  LexState *ls = fs->ls;
+  VarInfo *v = ls->vstack + dc->vtop;
+  VarInfo *ve = ls->vstack + ls->vtop;
+  for (; v < ve; v++)
+    if (gola_isgotolabel(v) && gcref(v->name) != NULL)
+      return 0;  /* Pending goto or break must be resolved in outer scope. */
+  fs->pc = fs->lasttarget = dc->pc;
+  fs->jpc = NO_JMP;
+  ls->vtop = dc->vtop;  /* Drop variables (and their debug info), too. */
+  return 1;
+}
+#else
+#define dead_begin(fs, dc)	UNUSED(dc)
+#define dead_end(fs, dc)	0
+#endif
+
 /* -- Function state management ------------------------------------------- */
 
 /* Fixup bytecode for prototype. */
@@ -1576,6 +1650,32 @@ static void fs_fixup_ret(FuncState *fs)
   }
 }
 
+#ifndef LUAJIT_DISABLE_PARSEOPT
+/* Thread jumps which target an unconditional jump to the final target. */
+static void fs_fixup_jmp(FuncState *fs)
+{
+  BCInsLine *base = fs->bcbase;
+  BCPos pc, n = fs->pc;
+  for (pc = 1; pc < n; pc++) {
+    BCIns *ip = &base[pc].ins;
+    if (bc_op(*ip) == BC_JMP) {
+      BCPos dest = pc+1+bc_j(*ip), target = dest;
+      BCReg ra = bc_a(*ip);
+      int limit = 8;  /* Limit chain length, also breaks jump cycles. */
+      while (bc_op(base[dest].ins) == BC_JMP && --limit >= 0) {
+	BCIns ins = base[dest].ins;
+	if (bc_a(ins) < ra) ra = bc_a(ins);  /* Fewer live slots. */
+	dest = dest+1+bc_j(ins);
+      }
+      if (dest != target && dest-(pc+1)+BCBIAS_J <= BCMAX_D) {
+	setbc_a(ip, ra);
+	setbc_d(ip, dest-(pc+1)+BCBIAS_J);
+      }
+    }
+  }
+}
+#endif
+
 /* Finish a FuncState and return the new prototype. */
 static GCproto *fs_finish(LexState *ls, BCLine line)
 {
@@ -1587,6 +1687,9 @@ static GCproto *fs_finish(LexState *ls, BCLine line)
 
   /* Apply final fixups. */
   fs_fixup_ret(fs);
+#ifndef LUAJIT_DISABLE_PARSEOPT
+  fs_fixup_jmp(fs);
+#endif
 
   /* Calculate total size of prototype including all colocated arrays. */
   sizept = sizeof(GCproto) + fs->pc*sizeof(BCIns) + fs->nkgc*sizeof(GCRef);
@@ -2147,12 +2250,20 @@ static void expr_next(LexState *ls)
   expr_tonextreg(ls->fs, &e);
 }
 
-/* Parse conditional expression. */
-static BCPos expr_cond(LexState *ls)
+/* Parse conditional expression. Also returns whether it's constant. */
+static BCPos expr_cond(LexState *ls, int *kcond)
 {
   ExpDesc v;
   expr(ls, &v);
   if (v.k == VKNIL) v.k = VKFALSE;
+  if (expr_hasjump(&v))
+    *kcond = -1;  /* Unknown. */
+  else if (v.k == VKFALSE)
+    *kcond = 0;  /* Always false. */
+  else if (v.k == VKSTR || v.k == VKNUM || v.k == VKTRUE)
+    *kcond = 1;  /* Always true. */
+  else
+    *kcond = -1;
   bcemit_branch_t(ls->fs, &v);
   return v.f;
 }
@@ -2439,9 +2550,12 @@ static void parse_while(LexState *ls, BCLine line)
   FuncState *fs = ls->fs;
   BCPos start, loop, condexit;
   FuncScope bl;
+  DeadCode dc;
+  int kcond;
   lj_lex_next(ls);  /* Skip 'while'. */
+  dead_begin(fs, &dc);
   start = fs->lasttarget = fs->pc;
-  condexit = expr_cond(ls);
+  condexit = expr_cond(ls, &kcond);
   fscope_begin(fs, &bl, FSCOPE_LOOP);
   lex_check(ls, TK_do);
   loop = bcemit_AD(fs, BC_LOOP, fs->nactvar, 0);
@@ -2451,6 +2565,8 @@ static void parse_while(LexState *ls, BCLine line)
   fscope_end(fs);
   jmp_tohere(fs, condexit);
   jmp_patchins(fs, loop, fs->pc);
+  if (kcond == 0 && dead_end(fs, &dc))
+    lua_assert(fs->pc == start);  /* Dropped loop which is never entered. */
 }
 
 /* Parse 'repeat' statement. */
@@ -2460,13 +2576,14 @@ static void parse_repeat(LexState *ls, BCLine line)
   BCPos loop = fs->lasttarget = fs->pc;
   BCPos condexit;
   FuncScope bl1, bl2;
+  int kcond;
   fscope_begin(fs, &bl1, FSCOPE_LOOP);  /* Breakable loop scope. */
   fscope_begin(fs, &bl2, 0);  /* Inner scope. */
   lj_lex_next(ls);  /* Skip 'repeat'. */
   bcemit_AD(fs, BC_LOOP, fs->nactvar, 0);
   parse_chunk(ls);
   lex_match(ls, TK_until, TK_repeat, line);
-  condexit = expr_cond(ls);  /* Parse condition (still inside inner scope). */
+  condexit = expr_cond(ls, &kcond);  /* Parse condition inside inner scope. */
   if (!(bl2.flags & FSCOPE_UPVAL)) {  /* No upvalues? Just end inner scope. */
     fscope_end(fs);
   } else {  /* Otherwise generate: cond: UCLO+JMP out, !cond: UCLO+JMP loop. */
@@ -2477,6 +2594,12 @@ static void parse_repeat(LexState *ls, BCLine line)
   }
   jmp_patch(fs, condexit, loop);  /* Jump backwards if !cond. */
   jmp_patchins(fs, loop, fs->pc);
+#ifndef LUAJIT_DISABLE_PARSEOPT
+  if (kcond == 1 && condexit == NO_JMP) {  /* 'until true' never loops. */
+    BCIns *ip = &fs->bcbase[loop].ins;
+    *ip = BCINS_AJ(BC_JMP, bc_a(*ip), 0);  /* No hot loop counting. */
+  }
+#endif
   fscope_end(fs);  /* End loop scope. */
 }
 
@@ -2611,11 +2734,11 @@ static void parse_for(LexState *ls, BCLine line)
 }
 
 /* Parse condition and 'then' block. */
-static BCPos parse_then(LexState *ls)
+static BCPos parse_then(LexState *ls, int *kcond)
 {
   BCPos condexit;
   lj_lex_next(ls);  /* Skip 'if' or 'elseif'. */
-  condexit = expr_cond(ls);
+  condexit = expr_cond(ls, kcond);
   lex_check(ls, TK_then);
   parse_block(ls);
   return condexit;
@@ -2625,22 +2748,37 @@ static BCPos parse_then(LexState *ls)
 static void parse_if(LexState *ls, BCLine line)
 {
   FuncState *fs = ls->fs;
-  BCPos flist;
-  BCPos escapelist = NO_JMP;
-  flist = parse_then(ls);
-  while (ls->token == TK_elseif) {  /* Parse multiple 'elseif' blocks. */
-    jmp_append(fs, &escapelist, bcemit_jmp(fs));
-    jmp_tohere(fs, flist);
-    flist = parse_then(ls);
-  }
-  if (ls->token == TK_else) {  /* Parse optional 'else' block. */
-    jmp_append(fs, &escapelist, bcemit_jmp(fs));
+  BCPos flist = NO_JMP;
+  BCPos escapelist = NO_JMP, deadlist = NO_JMP;
+  BCPos *elist = &escapelist;
+  DeadCode dc, dcrest;
+  int kcond = -1, fall = 0;
+  dcrest.pc = 0; dcrest.vtop = 0;  /* Silence compiler warning. */
+  do {  /* Parse 'if', multiple 'elseif' and optional 'else' blocks. */
+    if (kcond == 1 && elist == &escapelist) {
+      dead_begin(fs, &dcrest);  /* Always true: all other blocks are dead. */
+      elist = &deadlist;
+    }
+    if (fall)  /* Previous block needs to skip the remaining blocks. */
+      jmp_append(fs, elist, bcemit_jmp(fs));
     jmp_tohere(fs, flist);
-    lj_lex_next(ls);  /* Skip 'else'. */
-    parse_block(ls);
-  } else {
-    jmp_append(fs, &escapelist, flist);
-  }
+    if (ls->token == TK_else) {
+      lj_lex_next(ls);  /* Skip 'else'. */
+      parse_block(ls);
+      flist = NO_JMP;
+      break;
+    }
+    dead_begin(fs, &dc);
+    flist = parse_then(ls, &kcond);
+    fall = 1;
+    if (kcond == 0 && elist == &escapelist && dead_end(fs, &dc)) {
+      flist = NO_JMP;  /* Dropped block which is never executed. */
+      fall = 0;
+    }
+  } while (ls->token == TK_elseif || ls->token == TK_else);
+  jmp_append(fs, elist, flist);
+  if (elist == &deadlist && !dead_end(fs, &dcrest))
+    jmp_append(fs, &escapelist, deadlist);  /* Need to keep dead blocks. */
   jmp_tohere(fs, escapelist);
   lex_match(ls, TK_end, TK_if, line);
 }
@@ -2754,3 +2892,130 @@ GCproto *lj_parse(LexState *ls)
   return pt;
 }
 
+
+/* -- Data-only parser ---------------------------------------------------- */
+
+/* Max. number of key/value pairs collected before a table is created. */
+#define DATA_WINDOW	128
+
+static void data_value(LexState *ls);
+
+/* Create or grow table and store the key/value pairs above it. */
+static void data_flush(lua_State *L, TValue *o, uint32_t narr, uint32_t nhash)
+{
+  GCtab *t;
+  TValue *kv;
+  if (tvistab(o)) {
+    t = tabV(o);
+    if (narr >= t->asize)  /* Grow array part ahead of the stores. */
+      lj_tab_reasize(L, t, narr < 2*t->asize ? 2*t->asize : narr+1);
+  } else {  /* Presize new table from the pairs collected so far. */
+    t = lj_tab_new(L, narr ? narr+1 : 0, hsize2hbits(nhash));
+    settabV(L, o, t);
+  }
+  for (kv = o+1; kv < L->top; kv += 2)
+    copyTV(L, lj_tab_set(L, t, kv), kv+1);
+  lj_gc_anybarriert(L, t);
+  L->top = o+1;
+}
+
+/* Parse table constructor. Keys and values are collected on the stack. */
+static void data_table(LexState *ls)
+{
+  lua_State *L = ls->L;
+  BCLine line = ls->linenumber;
+  ptrdiff_t base = savestack(L, L->top);
+  uint32_t narr = 0, nhash = 0;
+  synlevel_begin(ls);
+  setnilV(L->top);  /* Reserve slot for the table. */
+  incr_top(L);
+  lj_lex_next(ls);
+  while (ls->token != '}') {
+    if (L->top - restorestack(L, base) > 2*DATA_WINDOW)
+      data_flush(L, restorestack(L, base), narr, nhash);
+    if (ls->token == '[') {
+      lj_lex_next(ls);
+      data_value(ls);
+      if (tvisnil(L->top-1))
+	lj_lex_error(ls, 0, LJ_ERR_NILIDX);
+      lex_check(ls, ']');
+      lex_check(ls, '=');
+      nhash++;
+    } else if (ls->token == TK_name || (!LJ_52 && ls->token == TK_goto)) {
+      setstrV(L, L->top, lex_str(ls));
+      incr_top(L);
+      lex_check(ls, '=');
+      nhash++;
+    } else {
+      setnumV(L->top, (lua_Number)++narr);
+      incr_top(L);
+    }
+    data_value(ls);
+    if (!lex_opt(ls, ',') && !lex_opt(ls, ';')) break;
+  }
+  lex_match(ls, '}', '{', line);
+  data_flush(L, restorestack(L, base), narr, nhash);
+  synlevel_end(ls);
+}
+
+/* Parse a constant value and push it on the stack. */
+static void data_value(LexState *ls)
+{
+  lua_State *L = ls->L;
+  switch (ls->token) {
+  case TK_number: case TK_string:
+    copyTV(L, L->top, &ls->tokenval);
+    break;
+  case '-':
+    lj_lex_next(ls);
+    if (ls->token != TK_number || !tvisnumber(&ls->tokenval))
+      err_token(ls, TK_number);
+    if (tvisint(&ls->tokenval) && intV(&ls->tokenval) != 0)
+      setintV(L->top, -intV(&ls->tokenval));
+    else
+      setnumV(L->top, -numberVnum(&ls->tokenval));
+    break;
+  case TK_nil:
+    setnilV(L->top);
+    break;
+  case TK_true: case TK_false:
+    setboolV(L->top, ls->token == TK_true);
+    break;
+  case '{':
+    data_table(ls);
+    return;
+  default:
+    err_syntax(ls, LJ_ERR_XSYMBOL);
+    break;
+  }
+  incr_top(L);
+  lj_lex_next(ls);
+}
+
+/* Entry point of the data-only parser: [return] value [;] */
+void lj_parse_data(LexState *ls)
+{
+  FuncState fs;
+  lua_State *L = ls->L;
+#ifdef LUAJIT_DISABLE_DEBUGINFO
+  ls->chunkname = lj_str_newlit(L, "=");
+#else
+  ls->chunkname = lj_str_newz(L, ls->chunkarg);
+#endif
+  setstrV(L, L->top, ls->chunkname);  /* Anchor chunkname string. */
+  incr_top(L);
+  ls->level = 0;
+  fs.kt = lj_tab_new(L, 0, 0);  /* Only used to anchor strings and cdata. */
+  settabV(L, L->top, fs.kt);
+  incr_top(L);
+  ls->fs = &fs;
+  lj_lex_next(ls);  /* Read-ahead first token. */
+  lex_opt(ls, TK_return);
+  data_value(ls);
+  lex_opt(ls, ';');
+  if (ls->token != TK_eof)
+    err_token(ls, TK_eof);
+  ls->fs = NULL;
+  L->top -= 2;  /* Drop chunkname and anchor table. */
+  copyTV(L, L->top-1, L->top+1);
+}
@@ -230,7 +230,7 @@ static void canonicalize_slots(jit_State *J)
 }
 
 /* Stop recording. */
-static void rec_stop(jit_State *J, TraceLink linktype, TraceNo lnk)
+void lj_record_stop(jit_State *J, TraceLink linktype, TraceNo lnk)
 {
   lj_trace_end(J);
   J->cur.linktype = (uint8_t)linktype;
@@ -538,12 +538,16 @@ static int innerloopleft(jit_State *J, const BCIns *pc)
 /* Handle the case when an interpreted loop op is hit. */
 static void rec_loop_interp(jit_State *J, const BCIns *pc, LoopEvent ev)
 {
-  if (J->parent == 0) {
-    if (pc == J->startpc && J->framedepth + J->retdepth == 0) {
+  if (J->parent == 0 && J->exitno == 0) {
+    if (J->retdepth && bc_op(J->cur.startins) == BC_FUNCF) {
+      /* Function trace returned to its caller. Stop at the caller's loop. */
+      if (ev != LOOPEV_LEAVE)
+	lj_record_stop(J, LJ_TRLINK_INTERP, 0);
+    } else if (pc == J->startpc && J->framedepth + J->retdepth == 0) {
       /* Same loop? */
       if (ev == LOOPEV_LEAVE)  /* Must loop back to form a root trace. */
 	lj_trace_err(J, LJ_TRERR_LLEAVE);
-      rec_stop(J, LJ_TRLINK_LOOP, J->cur.traceno);  /* Looping root trace. */
+      lj_record_stop(J, LJ_TRLINK_LOOP, J->cur.traceno);  /* Looping trace. */
     } else if (ev != LOOPEV_LEAVE) {  /* Entering inner loop? */
       /* It's usually better to abort here and wait until the inner loop
       ** is traced. But if the inner loop repeatedly didn't loop back,
@@ -568,15 +572,18 @@ static void rec_loop_interp(jit_State *J, const BCIns *pc, LoopEvent ev)
 /* Handle the case when an already compiled loop op is hit. */
 static void rec_loop_jit(jit_State *J, TraceNo lnk, LoopEvent ev)
 {
-  if (J->parent == 0) {  /* Root trace hit an inner loop. */
-    /* Better let the inner loop spawn a side trace back here. */
+  if (J->parent == 0 && J->exitno == 0 &&
+      !(J->retdepth && bc_op(J->cur.startins) == BC_FUNCF)) {
+    /* Root trace hit an inner loop.
+    ** Better let the inner loop spawn a side trace back here.
+    */
     lj_trace_err(J, LJ_TRERR_LINNER);
   } else if (ev != LOOPEV_LEAVE) {  /* Side trace enters a compiled loop. */
     J->instunroll = 0;  /* Cannot continue across a compiled loop op. */
     if (J->pc == J->startpc && J->framedepth + J->retdepth == 0)
-      rec_stop(J, LJ_TRLINK_LOOP, J->cur.traceno);  /* Form an extra loop. */
+      lj_record_stop(J, LJ_TRLINK_LOOP, J->cur.traceno);  /* Extra loop. */
     else
-      rec_stop(J, LJ_TRLINK_ROOT, lnk);  /* Link to the loop. */
+      lj_record_stop(J, LJ_TRLINK_ROOT, lnk);  /* Link to the loop. */
   }  /* Side trace continues across a loop that's left or not entered. */
 }
 
@@ -637,6 +644,37 @@ void lj_record_call(jit_State *J, BCReg func, ptrdiff_t nargs)
     lj_trace_err(J, LJ_TRERR_STACKOV);
 }
 
+/* Record ITERC of ipairs() inline: bump the key and index the array part.
+** This avoids the call frame and a snapshot with a frame link per iteration.
+*/
+static int rec_iterc_ipairs(jit_State *J, BCReg ra, BCReg nresults)
+{
+  cTValue *b = &J->L->base[ra];
+  RecordIndex ix;
+  TRef key, val;
+  BCReg i;
+  if (!(tvisfunc(b-3) && funcV(b-3)->c.ffid == FF_ipairs_aux &&
+	tvistab(b-2) && tvisnumber(b-1)))
+    return 0;  /* Let the fast function handle everything else. */
+  rec_call_specialize(J, funcV(b-3), getslot(J, ra-3));
+  ix.tab = getslot(J, ra-2);
+  settabV(J->L, &ix.tabv, tabV(b-2));
+  setintV(&ix.keyv, numberVint(b-1)+1);
+  key = lj_opt_narrow_toint(J, getslot(J, ra-1));
+  ix.key = key = emitir(IRTI(IR_ADD), key, lj_ir_kint(J, 1));
+  ix.val = 0; ix.idxchain = 0;
+  val = lj_record_idx(J, &ix);
+  for (i = 0; i < nresults; i++)
+    J->base[ra+i] = TREF_NIL;
+  if (!tref_isnil(val)) {
+    if (nresults > 0) J->base[ra] = key;
+    if (nresults > 1) J->base[ra+1] = val;
+  }
+  J->maxslot = ra + nresults;
+  J->postproc = LJ_POST_FFRETRY;  /* Skip the fast function dispatch. */
+  return 1;
+}
+
 /* Record tail call. */
 void lj_record_tailcall(jit_State *J, BCReg func, ptrdiff_t nargs)
 {
@@ -657,6 +695,22 @@ void lj_record_tailcall(jit_State *J, BCReg func, ptrdiff_t nargs)
     lj_trace_err(J, LJ_TRERR_LUNROLL);
 }
 
+/* Check for a tail call to a fast function, which would return to a lower
+** frame that cannot be handled. Better stop and let the interpreter do it.
+*/
+static int rec_tailcall_interp(jit_State *J, BCReg func)
+{
+  cTValue *functv = &J->L->base[func];
+  if (J->framedepth == 0 && !frame_islua(J->L->base - 1) &&
+      (J->parent != 0 || J->exitno != 0 ||
+       bc_op(J->cur.startins) == BC_FUNCF) &&
+      tvisfunc(functv) && !isluafunc(funcV(functv))) {
+    lj_record_stop(J, LJ_TRLINK_INTERP, 0);
+    return 1;
+  }
+  return 0;
+}
+
 /* Check unroll limits for down-recursion. */
 static int check_downrec_unroll(jit_State *J, GCproto *pt)
 {
@@ -689,8 +743,9 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
     (void)getslot(J, rbase+i);  /* Ensure all results have a reference. */
   while (frame_ispcall(frame)) {  /* Immediately resolve pcall() returns. */
     BCReg cbase = (BCReg)frame_delta(frame);
-    if (--J->framedepth <= 0)
-      lj_trace_err(J, LJ_TRERR_NYIRETL);
+    if (J->framedepth <= 0)
+      break;  /* pcall() frame is below the trace. Return via interpreter. */
+    J->framedepth--;
     lua_assert(J->baseslot > 1);
     gotresults++;
     rbase += cbase;
@@ -701,13 +756,13 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
   }
   /* Return to lower frame via interpreter for unhandled cases. */
   if (J->framedepth == 0 && J->pt && bc_isret(bc_op(*J->pc)) &&
-       (!frame_islua(frame) ||
+      frame == J->L->base - 1 && (!frame_islua(frame) ||
 	(J->parent == 0 && !bc_isret(bc_op(J->cur.startins))))) {
     /* NYI: specialize to frame type and return directly, not via RET*. */
     for (i = 0; i < (ptrdiff_t)rbase; i++)
       J->base[i] = 0;  /* Purge dead slots. */
     J->maxslot = rbase + (BCReg)gotresults;
-    rec_stop(J, LJ_TRLINK_RETURN, 0);  /* Return to interpreter. */
+    lj_record_stop(J, LJ_TRLINK_RETURN, 0);  /* Return to interpreter. */
     return;
   }
   if (frame_isvarg(frame)) {
@@ -731,7 +786,7 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
       if (check_downrec_unroll(J, pt)) {
 	J->maxslot = (BCReg)(rbase + gotresults);
 	lj_snap_purge(J);
-	rec_stop(J, LJ_TRLINK_DOWNREC, J->cur.traceno);  /* Down-recursion. */
+	lj_record_stop(J, LJ_TRLINK_DOWNREC, J->cur.traceno);  /* Down-recursion. */
 	return;
       }
       lj_snap_add(J);
@@ -744,7 +799,9 @@ void lj_record_ret(jit_State *J, BCReg rbase, ptrdiff_t gotresults)
       lua_assert(J->baseslot > cbase+1);
       J->baseslot -= cbase+1;
       J->base -= cbase+1;
-    } else if (J->parent == 0 && !bc_isret(bc_op(J->cur.startins))) {
+    } else if (J->parent == 0 && J->exitno == 0 &&
+	       !bc_isret(bc_op(J->cur.startins)) &&
+	       bc_op(J->cur.startins) != BC_FUNCF) {
       /* Return to lower frame would leave the loop in a root trace. */
       lj_trace_err(J, LJ_TRERR_LLEAVE);
     } else if (J->needsnap) {  /* Tailcalled to ff with side-effects. */
@@ -1042,7 +1099,8 @@ static void rec_mm_comp_cdata(jit_State *J, RecordIndex *ix, int op, MMS mm)
 /* -- Indexed access ------------------------------------------------------ */
 
 /* Record bounds-check. */
-static void rec_idx_abc(jit_State *J, TRef asizeref, TRef ikey, uint32_t asize)
+static void rec_idx_abc(jit_State *J, TRef asizeref, TRef ikey, int32_t k,
+			uint32_t asize)
 {
   /* Try to emit invariant bounds checks. */
   if ((J->flags & (JIT_F_OPT_LOOP|JIT_F_OPT_ABC)) ==
@@ -1051,25 +1109,43 @@ static void rec_idx_abc(jit_State *J, TRef asizeref, TRef ikey, uint32_t asize)
     IRIns *ir = IR(ref);
     int32_t ofs = 0;
     IRRef ofsref = 0;
-    /* Handle constant offsets. */
-    if (ir->o == IR_ADD && irref_isk(ir->op2)) {
+    IROp ofsop = IR_ADD;
+    /* Handle constant offsets and variable offsets, i.e. i+k, k+i or i-k. */
+    if ((ir->o == IR_ADD || ir->o == IR_ADDOV) && irref_isk(ir->op2)) {
       ofsref = ir->op2;
       ofs = IR(ofsref)->i;
       ref = ir->op1;
-      ir = IR(ref);
+    } else if (ir->o == IR_ADD || ir->o == IR_ADDOV ||
+	       ir->o == IR_SUB || ir->o == IR_SUBOV) {
+      IRRef1 other = 0;
+      if (ir->op1 == J->scev.idx)
+	other = ir->op2;
+      else if ((ir->o == IR_ADD || ir->o == IR_ADDOV) &&
+	       ir->op2 == J->scev.idx)
+	other = ir->op1;
+      if (other && !irref_isk(other)) {
+	ofsref = other;
+	ofsop = (ir->o == IR_SUB || ir->o == IR_SUBOV) ? IR_SUBOV : IR_ADDOV;
+	ref = J->scev.idx;
+      }
     }
+    ir = IR(ref);
     /* Got scalar evolution analysis results for this reference? */
     if (ref == J->scev.idx) {
       int32_t stop;
       lua_assert(irt_isint(J->scev.t) && ir->o == IR_SLOAD);
       stop = numberVint(&(J->L->base - J->baseslot)[ir->op1 + FORL_STOP]);
+      if (ofsref && !irref_isk(ofsref))  /* Runtime value of the offset. */
+	ofs = (int32_t)((uint32_t)k -
+		(uint32_t)numberVint(&(J->L->base - J->baseslot)[ir->op1]));
       /* Runtime value for stop of loop is within bounds? */
       if ((uint64_t)stop + ofs < (uint64_t)asize) {
 	/* Emit invariant bounds check for stop. */
-	emitir(IRTG(IR_ABC, IRT_P32), asizeref, ofs == 0 ? J->scev.stop :
-	       emitir(IRTI(IR_ADD), J->scev.stop, ofsref));
+	emitir(IRTG(IR_ABC, IRT_P32), asizeref, ofsref == 0 ? J->scev.stop :
+	       irref_isk(ofsref) ? emitir(IRTI(IR_ADD), J->scev.stop, ofsref) :
+	       emitir(IRTGI(ofsop), J->scev.stop, ofsref));
 	/* Emit invariant bounds check for start, if not const or negative. */
-	if (!(J->scev.dir && J->scev.start &&
+	if (!(J->scev.dir && J->scev.start && irref_isk(ofsref) &&
 	      (int64_t)IR(J->scev.start)->i + ofs >= 0))
 	  emitir(IRTG(IR_ABC, IRT_P32), asizeref, ikey);
 	return;
@@ -1097,7 +1173,7 @@ static TRef rec_idx_key(jit_State *J, RecordIndex *ix)
       TRef asizeref = emitir(IRTI(IR_FLOAD), ix->tab, IRFL_TAB_ASIZE);
       if ((MSize)k < t->asize) {  /* Currently an array key? */
 	TRef arrayref;
-	rec_idx_abc(J, asizeref, ikey, t->asize);
+	rec_idx_abc(J, asizeref, ikey, k, t->asize);
 	arrayref = emitir(IRT(IR_FLOAD, IRT_P32), ix->tab, IRFL_TAB_ARRAY);
 	return emitir(IRT(IR_AREF, IRT_P32), arrayref, ikey);
       } else {  /* Currently not in array (may be an array extension)? */
@@ -1389,6 +1465,40 @@ noconstify:
   }
 }
 
+/* Record closure creation. */
+static TRef rec_fnew(jit_State *J, GCproto *pt)
+{
+  TRef trpt = lj_ir_kgc(J, obj2gco(pt), IRT_PROTO);
+  /* Open upvalues are created relative to the base of the current frame. */
+  TRef base = emitir(IRT(IR_ADD, IRT_P32), REF_BASE,
+		     lj_ir_kint(J, ((int32_t)J->baseslot - 1) * 8));
+  return lj_ir_call(J, IRCALL_lj_func_newL_jit, trpt, getcurrf(J), base);
+}
+
+/* Record closing of upvalues. */
+static void rec_uclo(jit_State *J, BCReg ra)
+{
+  GCobj *o = gcref(J->L->openupval);
+  TRef level;
+  if (J->framedepth > 0 && !(o && uvval(gco2uv(o)) >= J->L->base + ra))
+    return;  /* Frame has been entered on trace and has no open upvalues. */
+  /* Closing copies the values from the stack, so write back open slots. */
+  for (; o && uvval(gco2uv(o)) >= J->L->base + ra; o = gcref(o->gch.nextgc)) {
+    BCReg s = (BCReg)(uvval(gco2uv(o)) - J->L->base);
+    if (s < J->maxslot && J->base[s]) {
+      TRef tr = J->base[s];
+      TRef ref = emitir(IRT(IR_ADD, IRT_P32), REF_BASE,
+			lj_ir_kint(J, ((int32_t)(J->baseslot + s) - 1) * 8));
+      if (!LJ_DUALNUM && tref_isinteger(tr))
+	tr = emitir(IRTN(IR_CONV), tr, IRCONV_NUM_INT);
+      emitir(IRT(IR_USTORE, tref_type(tr)), ref, tr);
+    }
+  }
+  level = emitir(IRT(IR_ADD, IRT_P32), REF_BASE,
+		 lj_ir_kint(J, ((int32_t)(J->baseslot + ra) - 1) * 8));
+  lj_ir_call(J, IRCALL_lj_func_closeuv, level);
+}
+
 /* -- Record calls to Lua functions --------------------------------------- */
 
 /* Check unroll limits for calls. */
@@ -1409,9 +1519,9 @@ static void check_call_unroll(jit_State *J, TraceNo lnk)
     if (count + J->tailcalled > J->param[JIT_P_recunroll]) {
       J->pc++;
       if (J->framedepth + J->retdepth == 0)
-	rec_stop(J, LJ_TRLINK_TAILREC, J->cur.traceno);  /* Tail-recursion. */
+	lj_record_stop(J, LJ_TRLINK_TAILREC, J->cur.traceno);  /* Tail-recursion. */
       else
-	rec_stop(J, LJ_TRLINK_UPREC, J->cur.traceno);  /* Up-recursion. */
+	lj_record_stop(J, LJ_TRLINK_UPREC, J->cur.traceno);  /* Up-recursion. */
     }
   } else {
     if (count > J->param[JIT_P_callunroll]) {
@@ -1485,9 +1595,9 @@ static void rec_func_jit(jit_State *J, TraceNo lnk)
   }
   J->instunroll = 0;  /* Cannot continue across a compiled function. */
   if (J->pc == J->startpc && J->framedepth + J->retdepth == 0)
-    rec_stop(J, LJ_TRLINK_TAILREC, J->cur.traceno);  /* Extra tail-recursion. */
+    lj_record_stop(J, LJ_TRLINK_TAILREC, J->cur.traceno);  /* Extra tailrec. */
   else
-    rec_stop(J, LJ_TRLINK_ROOT, lnk);  /* Link to the function. */
+    lj_record_stop(J, LJ_TRLINK_ROOT, lnk);  /* Link to the function. */
 }
 
 /* -- Vararg handling ----------------------------------------------------- */
@@ -1527,12 +1637,19 @@ static void rec_varg(jit_State *J, BCReg dst, ptrdiff_t nresults)
   } else {  /* Unknown number of varargs passed to trace. */
     TRef fr = emitir(IRTI(IR_SLOAD), 0, IRSLOAD_READONLY|IRSLOAD_FRAME);
     int32_t frofs = 8*(1+numparams)+FRAME_VARG;
+    int multres = 0;
+    if (nresults < 0 && !select_detect(J)) {
+      /* Specialize to the number of varargs, guarded below. */
+      if (nvararg < 0) nvararg = 0;
+      nresults = nvararg;
+      multres = 1;
+    }
     if (nresults >= 0) {  /* Known fixed number of results. */
       ptrdiff_t i;
       if (nvararg > 0) {
 	ptrdiff_t nload = nvararg >= nresults ? nresults : nvararg;
 	TRef vbase;
-	if (nvararg >= nresults)
+	if (nvararg >= nresults && !multres)
 	  emitir(IRTGI(IR_GE), fr, lj_ir_kint(J, frofs+8*(int32_t)nresults));
 	else
 	  emitir(IRTGI(IR_EQ), fr, lj_ir_kint(J, frame_ftsz(J->L->base-1)));
@@ -1552,13 +1669,16 @@ static void rec_varg(jit_State *J, BCReg dst, ptrdiff_t nresults)
       }
       for (i = nvararg; i < nresults; i++)
 	J->base[dst+i] = TREF_NIL;
-      if (dst + (BCReg)nresults > J->maxslot)
+      if (multres || dst + (BCReg)nresults > J->maxslot)
 	J->maxslot = dst + (BCReg)nresults;
-    } else if (select_detect(J)) {  /* y = select(x, ...) */
+    } else {  /* y = select(x, ...) */
       TRef tridx = J->base[dst-1];
       TRef tr = TREF_NIL;
       ptrdiff_t idx = lj_ffrecord_select_mode(J, tridx, &J->L->base[dst-1]);
-      if (idx < 0) goto nyivarg;
+      if (idx < 0) {
+	setintV(&J->errinfo, BC_VARG);
+	lj_trace_err_info(J, LJ_TRERR_NYIBC);
+      }
       if (idx != 0 && !tref_isinteger(tridx))
 	tridx = emitir(IRTGI(IR_CONV), tridx, IRCONV_INT_NUM|IRCONV_INDEX);
       if (idx != 0 && tref_isk(tridx)) {
@@ -1572,7 +1692,7 @@ static void rec_varg(jit_State *J, BCReg dst, ptrdiff_t nresults)
 	tr = emitir(IRTI(IR_BSHR), tmp, lj_ir_kint(J, 3));
 	if (idx != 0) {
 	  tridx = emitir(IRTI(IR_ADD), tridx, lj_ir_kint(J, -1));
-	  rec_idx_abc(J, tr, tridx, (uint32_t)nvararg);
+	  rec_idx_abc(J, tr, tridx, (int32_t)idx-1, (uint32_t)nvararg);
 	}
       } else {
 	TRef tmp = lj_ir_kint(J, frofs);
@@ -1596,10 +1716,6 @@ static void rec_varg(jit_State *J, BCReg dst, ptrdiff_t nresults)
       J->base[dst-2] = tr;
       J->maxslot = dst-1;
       J->bcskip = 2;  /* Skip CALLM + select. */
-    } else {
-    nyivarg:
-      setintV(&J->errinfo, BC_VARG);
-      lj_trace_err_info(J, LJ_TRERR_NYIBC);
     }
   }
 }
@@ -1614,6 +1730,39 @@ static TRef rec_tnew(jit_State *J, uint32_t ah)
   return emitir(IRTG(IR_TNEW, IRT_TAB), asize, hbits);
 }
 
+/* Record multi-result table store, i.e. {..., f()} or {..., ...}. */
+static void rec_tsetm(jit_State *J, BCReg ra, cTValue *kv)
+{
+  RecordIndex ix;
+  GCtab *t = tabV(&J->L->base[ra-1]);
+  uint32_t i = kv->u32.lo;  /* Integer start index is in lo-word. */
+  uint32_t n = J->maxslot > ra ? (uint32_t)(J->maxslot - ra) : 0;
+  IRIns *irt;
+  if (n == 0) return;
+  ix.tab = getslot(J, ra-1);
+  if (!tref_istab(ix.tab)) return;  /* Interpreter will throw. */
+  irt = IR(tref_ref(ix.tab));
+  if (irt->o == IR_TNEW && J->chain[IR_NEWREF] < tref_ref(ix.tab) &&
+      i+n > irt->op1 && i+n <= 0x7ff) {
+    /* Grow the array part of a fresh table at allocation time. This also
+    ** presizes the table for the interpreter, so the stores below all go
+    ** to the array part and the ABCs fold against the constant asize.
+    */
+    irt->op1 = (IRRef1)(i+n);
+    if (t->asize < i+n)
+      lj_tab_reasize(J->L, t, i+n-1);
+  }
+  settabV(J->L, &ix.tabv, t);
+  ix.idxchain = 0;  /* Raw stores. */
+  while (n-- > 0) {  /* Highest index first, so the other ABCs fold away. */
+    setintV(&ix.keyv, (int32_t)(i+n));
+    ix.key = lj_ir_kint(J, (int32_t)(i+n));
+    copyTV(J->L, &ix.valv, &J->L->base[ra+n]);
+    ix.val = getslot(J, ra+n);
+    lj_record_idx(J, &ix);
+  }
+}
+
 /* -- Record bytecode ops ------------------------------------------------- */
 
 /* Prepare for comparison. */
@@ -1960,10 +2109,25 @@ void lj_record_ins(jit_State *J)
     rc = emitir(IRTG(IR_TDUP, IRT_TAB),
 		lj_ir_ktab(J, gco2tab(proto_kgc(J->pt, ~(ptrdiff_t)rc))), 0);
     break;
+  case BC_TSETM:
+    rec_tsetm(J, ra, rcv);
+    J->maxslot = ra;  /* The table slot is at ra-1. */
+    break;
+
+  /* -- Closures and upvalue closing -------------------------------------- */
+
+  case BC_FNEW:
+    rc = rec_fnew(J, gco2pt(proto_kgc(J->pt, ~(ptrdiff_t)rc)));
+    break;
+  case BC_UCLO:
+    rec_uclo(J, ra);
+    break;
 
   /* -- Calls and vararg handling ----------------------------------------- */
 
   case BC_ITERC:
+    if (rec_iterc_ipairs(J, ra, bc_b(ins)-1))
+      break;
     J->base[ra] = getslot(J, ra-3);
     J->base[ra+1] = getslot(J, ra-2);
     J->base[ra+2] = getslot(J, ra-1);
@@ -1988,7 +2152,8 @@ void lj_record_ins(jit_State *J)
     rc = (BCReg)(J->L->top - J->L->base) - ra;
     /* fallthrough */
   case BC_CALLT:
-    lj_record_tailcall(J, ra, (ptrdiff_t)rc-1);
+    if (!rec_tailcall_interp(J, ra))
+      lj_record_tailcall(J, ra, (ptrdiff_t)rc-1);
     break;
 
   case BC_VARG:
@@ -2014,7 +2179,7 @@ void lj_record_ins(jit_State *J)
   case BC_JFORI:
     lua_assert(bc_op(pc[(ptrdiff_t)rc-BCBIAS_J]) == BC_JFORL);
     if (rec_for(J, pc, 0) != LOOPEV_LEAVE)  /* Link to existing loop. */
-      rec_stop(J, LJ_TRLINK_ROOT, bc_d(pc[(ptrdiff_t)rc-BCBIAS_J]));
+      lj_record_stop(J, LJ_TRLINK_ROOT, bc_d(pc[(ptrdiff_t)rc-BCBIAS_J]));
     /* Continue tracing if the loop is not entered. */
     break;
 
@@ -2082,9 +2247,6 @@ void lj_record_ins(jit_State *J)
   case BC_ITERN:
   case BC_ISNEXT:
   case BC_CAT:
-  case BC_UCLO:
-  case BC_FNEW:
-  case BC_TSETM:
     setintV(&J->errinfo, (int32_t)op);
     lj_trace_err_info(J, LJ_TRERR_NYIBC);
     break;
@@ -2150,6 +2312,12 @@ static const BCIns *rec_setup_root(jit_State *J)
     J->maxslot = J->pt->numparams;
     pc++;
     break;
+  case BC_CALL:
+  case BC_CALLM:
+    /* No bytecode range check for stitched traces. */
+    J->maxslot = ra + bc_b(ins) - 1;
+    pc++;
+    break;
   default:
     lua_assert(0);
     break;
@@ -2218,7 +2386,7 @@ void lj_record_setup(jit_State *J)
     if (traceref(J, J->cur.root)->nchild >= J->param[JIT_P_maxside] ||
 	T->snap[J->exitno].count >= J->param[JIT_P_hotexit] +
 				    J->param[JIT_P_tryside]) {
-      rec_stop(J, LJ_TRLINK_INTERP, 0);
+      lj_record_stop(J, LJ_TRLINK_INTERP, 0);
     }
   } else {  /* Root trace. */
     J->cur.root = 0;
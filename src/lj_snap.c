@@ -94,7 +94,8 @@ static BCReg snapshot_framelinks(jit_State *J, SnapEntry *map)
 {
   cTValue *frame = J->L->base - 1;
   cTValue *lim = J->L->base - J->baseslot;
-  cTValue *ftop = frame + funcproto(frame_func(frame))->framesize;
+  GCfunc *fn = frame_func(frame);
+  cTValue *ftop = isluafunc(fn) ? (frame+funcproto(fn)->framesize) : J->L->top;
   MSize f = 0;
   map[f++] = SNAP_MKPC(J->pc);  /* The current PC is always the first entry. */
   while (frame > lim) {  /* Backwards traversal of all frames above base. */
@@ -297,6 +298,161 @@ void lj_snap_shrink(jit_State *J)
   J->cur.nsnapmap = (uint16_t)(snap->mapofs + m);  /* Free up space in map. */
 }
 
+/* -- Snapshot map compression -------------------------------------------- */
+
+/* The snapshot maps of a saved trace are compressed. A map is either kept
+** in full (entries, PC, frame links) or as a delta against the map of the
+** previous snapshot:
+**
+**   SNAP_DELTA|nd, nd changed or SNAP_KILL entries, PC, frame links
+**
+** The frame links are omitted if the header has SNAP_SAMELINKS. Deltas
+** need both maps to be ordered by slot. Delta chains are kept short, since
+** a map is decoded on every access, e.g. for each exit.
+*/
+
+#define SNAP_MAXDELTA	8	/* Max. length of a delta chain. */
+
+/* Count the frame links referenced by the entries of a map. */
+static MSize snap_nlinks(const SnapEntry *map, MSize nent)
+{
+  MSize n, nl = 0;
+  for (n = 0; n < nent; n++)
+    nl += ((map[n] & (SNAP_CONT|SNAP_FRAME)) && snap_slot(map[n]) != 0);
+  return nl;
+}
+
+/* Check whether the map entries are ordered by slot. */
+static int snap_isordered(const SnapEntry *map, MSize nent)
+{
+  MSize n;
+  for (n = 1; n < nent; n++)
+    if (snap_slot(map[n-1]) >= snap_slot(map[n]))
+      return 0;
+  return 1;
+}
+
+/* Compute delta entries to get from map p to map c. */
+static MSize snap_delta(SnapEntry *d, const SnapEntry *p, MSize np,
+			const SnapEntry *c, MSize nc)
+{
+  MSize i = 0, j = 0, n = 0;
+  while (i < np || j < nc) {
+    if (j < nc && (i == np || snap_slot(c[j]) <= snap_slot(p[i]))) {
+      if (i < np && snap_slot(c[j]) == snap_slot(p[i])) {
+	if (c[j] != p[i]) d[n++] = c[j];  /* Changed slot. */
+	i++;
+      } else {
+	d[n++] = c[j];  /* New slot. */
+      }
+      j++;
+    } else {
+      d[n++] = SNAP(snap_slot(p[i]), SNAP_KILL, 0);  /* Removed slot. */
+      i++;
+    }
+  }
+  return n;
+}
+
+/* Apply delta entries to map p. */
+static MSize snap_undelta(SnapEntry *c, const SnapEntry *p, MSize np,
+			  const SnapEntry *d, MSize nd)
+{
+  MSize i = 0, j = 0, n = 0;
+  while (i < np || j < nd) {
+    if (j < nd && (i == np || snap_slot(d[j]) <= snap_slot(p[i]))) {
+      if (i < np && snap_slot(d[j]) == snap_slot(p[i]))
+	i++;  /* Changed or removed slot. */
+      if (!(d[j] & SNAP_KILL))
+	c[n++] = d[j];
+      j++;
+    } else {
+      c[n++] = p[i++];
+    }
+  }
+  return n;
+}
+
+/* Compress the snapshot maps of the current trace before it's saved. */
+void lj_snap_compress(jit_State *J)
+{
+  GCtrace *T = &J->cur;
+  SnapEntry prev[SNAP_MAXMAP], d[2*LJ_MAX_JSLOTS];
+  MSize pnent = 0, pnl = 0, w = 0, chain = 0;
+  int pordered = 0;
+  SnapNo i;
+  for (i = 0; i < T->nsnap; i++) {
+    SnapShot *snap = &T->snap[i];
+    SnapEntry *map = &T->snapmap[snap->mapofs];
+    MSize nent = snap->nent, nl = snap_nlinks(map, nent);
+    MSize len = nent + 1 + nl;
+    int ordered = snap_isordered(map, nent);
+    lua_assert(len <= SNAP_MAXMAP && w <= snap->mapofs);
+    if (i > 0 && nent > 0 && chain < SNAP_MAXDELTA && ordered && pordered) {
+      MSize nd = snap_delta(d, prev, pnent, map, nent);
+      int samelinks = (nl == pnl &&
+	!memcmp(map+nent+1, prev+pnent+1, nl*sizeof(SnapEntry)));
+      if (2 + nd + (samelinks ? 0 : nl) < len) {  /* Store delta map. */
+	SnapEntry *q = &T->snapmap[w];
+	memcpy(prev, map, len*sizeof(SnapEntry));
+	*q++ = SNAP_DELTA + (samelinks ? SNAP_SAMELINKS : 0) + nd;
+	memcpy(q, d, nd*sizeof(SnapEntry)); q += nd;
+	*q++ = prev[nent];  /* PC. */
+	if (!samelinks) {
+	  memcpy(q, prev+nent+1, nl*sizeof(SnapEntry)); q += nl;
+	}
+	snap->mapofs = (uint16_t)w;
+	w = (MSize)(q - T->snapmap);
+	pnent = nent; pnl = nl; pordered = ordered;
+	chain++;
+	continue;
+      }
+    }
+    memcpy(prev, map, len*sizeof(SnapEntry));  /* Store full map. */
+    memmove(&T->snapmap[w], prev, len*sizeof(SnapEntry));
+    snap->mapofs = (uint16_t)w;
+    w += len;
+    pnent = nent; pnl = nl; pordered = ordered;
+    chain = 0;
+  }
+  T->nsnapmap = (uint16_t)w;
+}
+
+/* Get the map of a snapshot of a saved trace. Delta maps are decoded into
+** buf, which must have room for SNAP_MAXMAP entries.
+*/
+SnapEntry *lj_snap_map(GCtrace *T, SnapNo snapno, SnapEntry *buf)
+{
+  SnapShot *snap = &T->snap[snapno];
+  SnapEntry *map = &T->snapmap[snap->mapofs];
+  SnapEntry tmp[LJ_MAX_JSLOTS];
+  SnapEntry *src, *dst, *links;
+  SnapNo k = snapno;
+  MSize nent;
+  if (snap->nent == 0 || !(map[0] & SNAP_DELTA))
+    return map;  /* Full map. */
+  do {  /* Find the full map that starts the delta chain. */
+    SnapShot *ks = &T->snap[--k];
+    src = &T->snapmap[ks->mapofs];
+    nent = ks->nent;
+  } while (nent != 0 && (src[0] & SNAP_DELTA));
+  links = src + nent + 1;
+  dst = ((snapno - k) & 1) ? buf : tmp;  /* Final delta ends up in buf. */
+  while (k++ < snapno) {
+    SnapEntry *dmap = &T->snapmap[T->snap[k].mapofs];
+    MSize nd = dmap[0] & 0xffff;
+    nent = snap_undelta(dst, src, nent, dmap+1, nd);
+    if (!(dmap[0] & SNAP_SAMELINKS))
+      links = dmap + 2 + nd;
+    src = dst;
+    dst = dst == buf ? tmp : buf;
+  }
+  lua_assert(src == buf && nent == snap->nent);
+  buf[nent] = map[1 + (map[0] & 0xffff)];  /* PC. */
+  memcpy(buf+nent+1, links, snap_nlinks(buf, nent)*sizeof(SnapEntry));
+  return buf;
+}
+
 /* -- Snapshot access ----------------------------------------------------- */
 
 /* Initialize a Bloom Filter with all renamed refs.
@@ -326,8 +482,8 @@ static RegSP snap_renameref(GCtrace *T, SnapNo lim, IRRef ref, RegSP rs)
 /* Copy RegSP from parent snapshot to the parent links of the IR. */
 IRIns *lj_snap_regspmap(GCtrace *T, SnapNo snapno, IRIns *ir)
 {
-  SnapShot *snap = &T->snap[snapno];
-  SnapEntry *map = &T->snapmap[snap->mapofs];
+  SnapEntry mapbuf[SNAP_MAXMAP];
+  SnapEntry *map = lj_snap_map(T, snapno, mapbuf);
   BloomFilter rfilt = snap_renamefilter(T, snapno);
   MSize n = 0;
   IRRef ref = 0;
@@ -336,7 +492,7 @@ IRIns *lj_snap_regspmap(GCtrace *T, SnapNo snapno, IRIns *ir)
     if (ir->o == IR_SLOAD) {
       if (!(ir->op2 & IRSLOAD_PARENT)) break;
       for ( ; ; n++) {
-	lua_assert(n < snap->nent);
+	lua_assert(n < T->snap[snapno].nent);
 	if (snap_slot(map[n]) == ir->op1) {
 	  ref = snap_ref(map[n++]);
 	  break;
@@ -425,7 +581,8 @@ static LJ_AINLINE int snap_sunk_store(GCtrace *T, IRIns *ira, IRIns *irs)
 void lj_snap_replay(jit_State *J, GCtrace *T)
 {
   SnapShot *snap = &T->snap[J->exitno];
-  SnapEntry *map = &T->snapmap[snap->mapofs];
+  SnapEntry mapbuf[SNAP_MAXMAP];
+  SnapEntry *map = lj_snap_map(T, J->exitno, mapbuf);
   MSize n, nent = snap->nent;
   BloomFilter seen = 0;
   int pass23 = 0;
@@ -790,8 +947,9 @@ const BCIns *lj_snap_restore(jit_State *J, void *exptr)
   GCtrace *T = traceref(J, J->parent);
   SnapShot *snap = &T->snap[snapno];
   MSize n, nent = snap->nent;
-  SnapEntry *map = &T->snapmap[snap->mapofs];
-  SnapEntry *flinks = &T->snapmap[snap_nextofs(T, snap)-1];
+  SnapEntry mapbuf[SNAP_MAXMAP];
+  SnapEntry *map = lj_snap_map(T, snapno, mapbuf);
+  SnapEntry *flinks = map + nent + snap_nlinks(map, nent);
   int32_t ftsz0;
   TValue *frame;
   BloomFilter rfilt = snap_renamefilter(T, snapno);
@@ -10,9 +10,14 @@
 #include "lj_jit.h"
 
 #if LJ_HASJIT
+/* Max. size of a decoded snapshot map: entries, PC and frame links. */
+#define SNAP_MAXMAP	(2*LJ_MAX_JSLOTS+1)
+
 LJ_FUNC void lj_snap_add(jit_State *J);
 LJ_FUNC void lj_snap_purge(jit_State *J);
 LJ_FUNC void lj_snap_shrink(jit_State *J);
+LJ_FUNC void lj_snap_compress(jit_State *J);
+LJ_FUNC SnapEntry *lj_snap_map(GCtrace *T, SnapNo snapno, SnapEntry *buf);
 LJ_FUNC IRIns *lj_snap_regspmap(GCtrace *T, SnapNo snapno, IRIns *ir);
 LJ_FUNC void lj_snap_replay(jit_State *J, GCtrace *T);
 LJ_FUNC const BCIns *lj_snap_restore(jit_State *J, void *exptr);
@@ -26,6 +26,7 @@
 #include "lj_vm.h"
 #include "lj_lex.h"
 #include "lj_alloc.h"
+#include "luajit.h"
 
 /* -- Stack handling ------------------------------------------------------ */
 
@@ -49,6 +50,90 @@
 ** with 5 extra slots.
 */
 
+#if LJ_HASSTACKMAP
+/* -- Stack mappings ------------------------------------------------------ */
+
+/* Explanation of stack mappings:
+**
+** A stack which grows beyond LJ_STACKMAP_MIN slots is moved once into a
+** private mapping with room for LJ_STACKMAP_SIZE slots. The OS commits the
+** pages of the mapping lazily, so any further growth up to that size
+** neither copies nor moves the stack. The pages above the stack size are
+** handed back to the OS when the stack shrinks. A stack which outgrows the
+** mapping moves back to the heap.
+**
+** Only the used part of a mapping is accounted for in the GC total. The
+** number of mappings is limited, since they compete for the same address
+** space as all other GC objects on x64. Stacks stay on the heap otherwise.
+*/
+#define LJ_STACKMAP_MIN		((MSize)(LJ_PAGESIZE/sizeof(TValue)))
+#define LJ_STACKMAP_SIZE	8192
+#define LJ_STACKMAP_MAXNUM	4096
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE		0
+#endif
+
+#if LJ_64
+/* The stack must be addressable with 32 bit references. */
+#ifndef MAP_32BIT
+#error "NYI: need an equivalent of MAP_32BIT for this 64 bit OS"
+#endif
+#define STACKMAP_FLAGS	(MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_32BIT)
+#else
+#define STACKMAP_FLAGS	(MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE)
+#endif
+
+#define STACKMAP_BYTES	(LJ_STACKMAP_SIZE*sizeof(TValue))
+
+/* Reserve a new stack mapping. Returns NULL on failure. */
+static TValue *stackmap_new(global_State *g)
+{
+  int olderr;
+  void *p;
+  if (g->stackmapnum >= LJ_STACKMAP_MAXNUM)
+    return NULL;
+  olderr = errno;
+  p = mmap(NULL, STACKMAP_BYTES, PROT_READ|PROT_WRITE, STACKMAP_FLAGS, -1, 0);
+  if (p != MAP_FAILED && !checkptr32(p)) {
+    munmap(p, STACKMAP_BYTES);
+    p = MAP_FAILED;
+  }
+  errno = olderr;
+  if (p == MAP_FAILED)
+    return NULL;
+  g->stackmapnum++;
+  return (TValue *)p;
+}
+
+/* Free a stack mapping. */
+static void stackmap_free(global_State *g, TValue *st)
+{
+  int olderr = errno;
+  munmap((void *)st, STACKMAP_BYTES);
+  errno = olderr;
+  g->stackmapnum--;
+}
+
+/* Hand back all pages above the first n slots of a stack mapping. */
+static void stackmap_release(TValue *st, MSize n)
+{
+  uintptr_t p = ((uintptr_t)(st+n) + LJ_PAGESIZE-1) & ~(uintptr_t)(LJ_PAGESIZE-1);
+  uintptr_t e = (uintptr_t)st + STACKMAP_BYTES;
+  if (p < e) {
+    int olderr = errno;
+    madvise((void *)p, (size_t)(e - p), MADV_DONTNEED);
+    errno = olderr;
+  }
+}
+#endif
+
 /* Resize stack slots and adjust pointers in state. */
 static void resizestack(lua_State *L, MSize n)
 {
@@ -58,6 +143,36 @@ static void resizestack(lua_State *L, MSize n)
   MSize realsize = n + 1 + LJ_STACK_EXTRA;
   GCobj *up;
   lua_assert((MSize)(tvref(L->maxstack)-oldst)==L->stacksize-LJ_STACK_EXTRA-1);
+#if LJ_HASSTACKMAP
+  if (L->stackmap) {
+    global_State *g = G(L);
+    if (realsize <= L->stackmap) {  /* Resize in place. */
+      if (realsize < oldsize)
+	stackmap_release(oldst, realsize);
+      g->gc.total = (g->gc.total - oldsize*(MSize)sizeof(TValue)) +
+		    realsize*(MSize)sizeof(TValue);
+      setmref(L->maxstack, oldst + n);
+      while (oldsize < realsize)  /* Clear new slots. */
+	setnilV(oldst + oldsize++);
+      L->stacksize = realsize;
+      return;
+    }
+    /* Outgrown the mapping: move the stack back to the heap. */
+    st = lj_mem_newvec(L, realsize, TValue);
+    memcpy(st, oldst, oldsize*sizeof(TValue));
+    stackmap_free(g, oldst);
+    g->gc.total -= oldsize*(MSize)sizeof(TValue);
+    L->stackmap = 0;
+  } else if (realsize > oldsize && realsize >= LJ_STACKMAP_MIN &&
+	     realsize <= LJ_STACKMAP_SIZE &&
+	     (st = stackmap_new(G(L))) != NULL) {
+    global_State *g = G(L);
+    memcpy(st, oldst, oldsize*sizeof(TValue));
+    lj_mem_freevec(g, oldst, oldsize, TValue);
+    g->gc.total += realsize*(MSize)sizeof(TValue);
+    L->stackmap = LJ_STACKMAP_SIZE;
+  } else
+#endif
   st = (TValue *)lj_mem_realloc(L, tvref(L->stack),
 				(MSize)(L->stacksize*sizeof(TValue)),
 				(MSize)(realsize*sizeof(TValue)));
@@ -75,6 +190,19 @@ static void resizestack(lua_State *L, MSize n)
     setmref(G(L)->jit_base, mref(G(L)->jit_base, char) + delta);
 }
 
+/* Free the stack of a state. */
+static void stack_free(global_State *g, lua_State *L)
+{
+#if LJ_HASSTACKMAP
+  if (L->stackmap) {
+    stackmap_free(g, tvref(L->stack));
+    g->gc.total -= L->stacksize*(MSize)sizeof(TValue);
+    return;
+  }
+#endif
+  lj_mem_freevec(g, tvref(L->stack), L->stacksize, TValue);
+}
+
 /* Relimit stack after error, in case the limit was overdrawn. */
 void lj_state_relimitstack(lua_State *L)
 {
@@ -131,6 +259,54 @@ static void stack_init(lua_State *L1, lua_State *L)
     setnilV(st++);
 }
 
+/* Reset the stack of a recycled state. */
+static void stack_reset(lua_State *L1)
+{
+  TValue *stend, *st = tvref(L1->stack);
+  stend = st + L1->stacksize;
+  L1->base = L1->top = st+1;
+  setthreadV(L1, st, L1);  /* Needed for curr_funcisL() on empty stack. */
+  while (++st < stend)  /* Clear all slots. */
+    setnilV(st);
+}
+
+/* -- Coroutine pool ------------------------------------------------------ */
+
+/* Default max. number of dead coroutines kept for recycling. */
+#define LJ_THPOOL_DEFAULT	256
+
+/* Only recycle coroutines with a stack up to this size (incl. extra). */
+#define LJ_THPOOL_MAXSTACK	(4*(LJ_STACK_START+LJ_STACK_EXTRA))
+
+/* Memory held by a pooled coroutine. Not accounted for in the GC total. */
+#define thpool_size(L1) \
+  ((MSize)sizeof(lua_State) + (L1)->stacksize*(MSize)sizeof(TValue))
+
+/* Free coroutines from the pool until at most max are left. */
+static void thpool_trim(global_State *g, MSize max)
+{
+  while (g->thpool.num > max) {
+    lua_State *L1 = &gcref(g->thpool.list)->th;
+    setgcrefr(g->thpool.list, L1->nextgc);
+    g->thpool.num--;
+    g->gc.total += thpool_size(L1);
+    stack_free(g, L1);
+    lj_mem_freet(g, L1);
+  }
+}
+
+/* Set the max. size of the coroutine pool. Returns the previous size. */
+LUA_API int luaJIT_threadpool(lua_State *L, int size)
+{
+  global_State *g = G(L);
+  int osize = (int)g->thpool.max;
+  if (size >= 0) {
+    g->thpool.max = (MSize)size;
+    thpool_trim(g, g->thpool.max);
+  }
+  return osize;
+}
+
 /* -- State handling ------------------------------------------------------ */
 
 /* Open parts that may cause memory-allocation errors. */
@@ -157,6 +333,7 @@ static void close_state(lua_State *L)
   global_State *g = G(L);
   lj_func_closeuv(L, tvref(L->stack));
   lj_gc_freeall(g);
+  thpool_trim(g, 0);
   lua_assert(gcref(g->gc.root) == obj2gco(L));
   lua_assert(g->strnum == 0);
   lj_trace_freestate(g);
@@ -165,7 +342,7 @@ static void close_state(lua_State *L)
 #endif
   lj_mem_freevec(g, g->strhash, g->strmask+1, GCRef);
   lj_str_freebuf(g, &g->tmpbuf);
-  lj_mem_freevec(g, tvref(L->stack), L->stacksize, TValue);
+  stack_free(g, L);
   lua_assert(g->gc.total == sizeof(GG_State));
 #ifndef LUAJIT_USE_SYSMALLOC
   if (g->allocf == lj_alloc_f)
@@ -210,6 +387,7 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud)
   g->gc.total = sizeof(GG_State);
   g->gc.pause = LUAI_GCPAUSE;
   g->gc.stepmul = LUAI_GCMUL;
+  g->thpool.max = LJ_THPOOL_DEFAULT;
   lj_dispatch_init((GG_State *)L);
   L->status = LUA_ERRERR+1;  /* Avoid touching the stack upon memory error. */
   if (lj_vm_cpcall(L, NULL, NULL, cpluaopen) != 0) {
@@ -260,18 +438,39 @@ LUA_API void lua_close(lua_State *L)
 
 lua_State *lj_state_new(lua_State *L)
 {
-  lua_State *L1 = lj_mem_newobj(L, lua_State);
+  global_State *g = G(L);
+  lua_State *L1;
+  if (gcref(g->thpool.list)) {  /* Recycle a dead coroutine. */
+    L1 = &gcref(g->thpool.list)->th;
+    setgcrefr(g->thpool.list, L1->nextgc);
+    g->thpool.num--;
+    g->thpool.reused++;
+    g->gc.total += thpool_size(L1);  /* Same GC pacing as for allocations. */
+    /* Link it to the root set, same as lj_mem_newgco(). */
+    setgcrefr(L1->nextgc, g->gc.root);
+    setgcref(g->gc.root, obj2gco(L1));
+    newwhite(g, L1);
+  } else {
+    L1 = lj_mem_newobj(L, lua_State);
+    L1->stacksize = 0;
+#if LJ_HASSTACKMAP
+    L1->stackmap = 0;
+#endif
+    setmref(L1->stack, NULL);
+    g->thpool.created++;
+  }
   L1->gct = ~LJ_TTHREAD;
   L1->dummy_ffid = FF_C;
   L1->status = 0;
-  L1->stacksize = 0;
-  setmref(L1->stack, NULL);
   L1->cframe = NULL;
   /* NOBARRIER: The lua_State is new (marked white). */
   setgcrefnull(L1->openupval);
   setmrefr(L1->glref, L->glref);
   setgcrefr(L1->env, L->env);
-  stack_init(L1, L);  /* init stack */
+  if (L1->stacksize)
+    stack_reset(L1);  /* Reuse stack of recycled state. */
+  else
+    stack_init(L1, L);  /* init stack */
   lua_assert(iswhite(obj2gco(L1)));
   return L1;
 }
@@ -281,7 +480,18 @@ void LJ_FASTCALL lj_state_free(global_State *g, lua_State *L)
   lua_assert(L != mainthread(g));
   lj_func_closeuv(L, tvref(L->stack));
   lua_assert(gcref(L->openupval) == NULL);
-  lj_mem_freevec(g, tvref(L->stack), L->stacksize, TValue);
+  if (g->thpool.num < g->thpool.max && L->stacksize <= LJ_THPOOL_MAXSTACK
+#if LJ_HASSTACKMAP
+      && !L->stackmap
+#endif
+      ) {  /* Keep state and stack for recycling. */
+    setgcrefr(L->nextgc, g->thpool.list);
+    setgcref(g->thpool.list, obj2gco(L));
+    g->thpool.num++;
+    g->gc.total -= thpool_size(L);
+    return;
+  }
+  stack_free(g, L);
   lj_mem_freet(g, L);
 }
 
@@ -18,6 +18,11 @@
 #include "lj_state.h"
 #include "lj_char.h"
 
+#if LJ_TARGET_X86ORX64 && (LJ_64 || defined(__SSE2__))
+#define LJ_STR_SSE2		1
+#include <emmintrin.h>
+#endif
+
 /* -- String interning ---------------------------------------------------- */
 
 /* Ordered compare of strings. Assumes string data is 4-byte aligned. */
@@ -167,16 +172,176 @@ void LJ_FASTCALL lj_str_free(global_State *g, GCstr *s)
   lj_mem_free(g, s, sizestring(s));
 }
 
+/* -- String search ------------------------------------------------------- */
+
+/* Find fixed string p inside string s. Returns offset or -1. */
+int32_t lj_str_find(const char *s, const char *p, MSize slen, MSize plen)
+{
+  if (plen <= slen) {
+    const char *q = s, *e = s + (slen - plen);  /* e: last possible start. */
+    MSize last = plen-1;
+    if (plen == 0) return 0;  /* Empty strings are everywhere. */
+#if LJ_STR_SSE2
+    if (slen - plen >= 16) {
+      /* Compare first and last char of p at 16 positions at once. This
+      ** works much better than memchr() for common first chars.
+      */
+      __m128i v0 = _mm_set1_epi8(p[0]), v1 = _mm_set1_epi8(p[last]);
+      for (; q + 15 <= e; q += 16) {
+	__m128i a = _mm_loadu_si128((const __m128i *)q);
+	__m128i b = _mm_loadu_si128((const __m128i *)(q + last));
+	uint32_t m = (uint32_t)_mm_movemask_epi8(
+	  _mm_and_si128(_mm_cmpeq_epi8(a, v0), _mm_cmpeq_epi8(b, v1)));
+	while (m) {
+	  uint32_t i = lj_ffs(m);
+	  if (plen <= 2 || memcmp(q+i+1, p+1, plen-2) == 0)
+	    return (int32_t)(q+i - s);
+	  m &= m-1;
+	}
+      }
+    }
+#endif
+    while (q <= e && (q = (const char *)memchr(q, p[0], (size_t)(e-q+1)))) {
+      if (memcmp(q+1, p+1, last) == 0)
+	return (int32_t)(q - s);
+      q++;
+    }
+  }
+  return -1;  /* Not found. */
+}
+
+/* Check whether string has any pattern matching chars. */
+int lj_str_haspattern(GCstr *s)
+{
+  return strpbrk(strdata(s), LJ_STR_PATSPECIALS) != NULL;
+}
+
 /* -- Type conversions ---------------------------------------------------- */
 
+/* Powers of ten which are exactly representable as doubles. */
+static const double str_pow10[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Round y >= 0 to the nearest integer. Returns 0 if it's too close to a tie.
+**
+** y is the correctly rounded result of a single multiplication or division
+** by an exact power of ten. So it's off from the true value by at most half
+** an ulp, which only matters if the fraction is close to one half. These
+** cases are left to the C library, which works with the exact value.
+*/
+static int str_round(double y, uint64_t *r)
+{
+  uint64_t u = (uint64_t)y;
+  double f = y - (double)(int64_t)u;
+  double d = f - 0.5;
+  if (d < 0) d = -d;
+  if (LJ_UNLIKELY(d <= y * (2.0/4503599627370496.0))) return 0;
+  *r = u + (f > 0.5);
+  return 1;
+}
+
+/* Print unsigned integer backwards, with at least ndig digits. */
+static char *str_bufdigits(char *p, uint64_t u, int ndig)
+{
+  do { *--p = (char)('0' + (uint32_t)(u % 10)); u /= 10; ndig--; } while (u);
+  while (ndig-- > 0) *--p = '0';
+  return p;
+}
+
+/* Print finite number like "%.<prec>g" with 1 <= prec <= 15.
+** Returns the length or 0 if the C library has to do it.
+*/
+size_t lj_str_bufnumg(char *s, lua_Number n, int prec)
+{
+  TValue o;
+  char dig[16], *p = s, *q;
+  double y;
+  uint64_t r;
+  int32_t e2, e;
+  int nd, k;
+  lua_assert(prec >= 1 && prec <= 15);
+  o.n = n;
+  if ((int32_t)o.u32.hi < 0) { *p++ = '-'; n = -n; }
+  if (n < str_pow10[prec] && n == (lua_Number)(int64_t)n) {
+    /* Fast path for integers with at most prec digits. */
+    q = str_bufdigits(dig+16, (uint64_t)n, 1);
+    while (q < dig+16) *p++ = *q++;
+    return (size_t)(p - s);
+  }
+  /* Estimate decimal exponent from binary exponent (low by at most 1). */
+  e2 = (int32_t)((o.u32.hi >> 20) & 0x7ff) - 1023;
+  e = (e2 * 78913) >> 18;
+  for (;;) {
+    k = prec-1 - e;
+    if (k < -22 || k > 22) return 0;
+    y = k >= 0 ? n * str_pow10[k] : n / str_pow10[-k];
+    if (y < str_pow10[prec]) break;
+    e++;
+  }
+  if (!str_round(y, &r)) return 0;
+  if (r == (uint64_t)str_pow10[prec]) { r /= 10; e++; }  /* Carry. */
+  str_bufdigits(dig+prec, r, prec);
+  for (nd = prec; nd > 1 && dig[nd-1] == '0'; nd--) ;  /* Strip zeros. */
+  if (e < -4 || e >= prec) {  /* Exponential format. */
+    int i;
+    *p++ = dig[0];
+    if (nd > 1) {
+      *p++ = '.';
+      for (i = 1; i < nd; i++) *p++ = dig[i];
+    }
+    *p++ = 'e';
+    if (e < 0) { *p++ = '-'; e = -e; } else { *p++ = '+'; }
+    if (e >= 100) { *p++ = (char)('0' + e / 100); e %= 100; }
+    *p++ = (char)('0' + e / 10);
+    *p++ = (char)('0' + e % 10);
+  } else if (e < 0) {  /* Fixed format with leading zeros. */
+    int i;
+    *p++ = '0'; *p++ = '.';
+    for (i = -1; i > e; i--) *p++ = '0';
+    for (i = 0; i < nd; i++) *p++ = dig[i];
+  } else {  /* Fixed format. */
+    int i;
+    for (i = 0; i <= e; i++) *p++ = dig[i];
+    if (nd > e+1) {
+      *p++ = '.';
+      for (; i < nd; i++) *p++ = dig[i];
+    }
+  }
+  return (size_t)(p - s);
+}
+
+/* Print finite number like "%.<prec>f" with 0 <= prec <= 22.
+** Returns the length or 0 if the C library has to do it.
+*/
+size_t lj_str_bufnumf(char *s, lua_Number n, int prec)
+{
+  TValue o;
+  char dig[32], *p = s, *q;
+  double y;
+  uint64_t r;
+  lua_assert(prec >= 0 && prec <= 22);
+  o.n = n;
+  if ((int32_t)o.u32.hi < 0) { *p++ = '-'; n = -n; }
+  y = n * str_pow10[prec];
+  if (!(y < 4503599627370496.0) || !str_round(y, &r)) return 0;
+  q = str_bufdigits(dig+32, r, prec+1);
+  while (q < dig+32-prec) *p++ = *q++;
+  if (prec > 0) {
+    *p++ = '.';
+    while (q < dig+32) *p++ = *q++;
+  }
+  return (size_t)(p - s);
+}
+
 /* Print number to buffer. Canonicalizes non-finite values. */
 size_t LJ_FASTCALL lj_str_bufnum(char *s, cTValue *o)
 {
   if (LJ_LIKELY((o->u32.hi << 1) < 0xffe00000)) {  /* Finite? */
     lua_Number n = o->n;
-#if __BIONIC__
-    if (tvismzero(o)) { s[0] = '-'; s[1] = '0'; return 2; }
-#endif
+    size_t len = lj_str_bufnumg(s, n, 14);  /* Same as LUA_NUMBER_FMT. */
+    if (LJ_LIKELY(len)) return len;
     return (size_t)lua_number2str(s, n);
   } else if (((o->u32.hi & 0x000fffff) | o->u32.lo) != 0) {
     s[0] = 'n'; s[1] = 'a'; s[2] = 'n'; return 3;
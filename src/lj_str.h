@@ -19,7 +19,16 @@ LJ_FUNC void LJ_FASTCALL lj_str_free(global_State *g, GCstr *s);
 #define lj_str_newz(L, s)	(lj_str_new(L, s, strlen(s)))
 #define lj_str_newlit(L, s)	(lj_str_new(L, "" s, sizeof(s)-1))
 
+/* String search. */
+#define LJ_STR_PATSPECIALS	"^$*+?.([%-"  /* Pattern matching chars. */
+
+LJ_FUNC int32_t lj_str_find(const char *s, const char *p,
+			    MSize slen, MSize plen);
+LJ_FUNC int lj_str_haspattern(GCstr *s);
+
 /* Type conversions. */
+LJ_FUNC size_t lj_str_bufnumg(char *s, lua_Number n, int prec);
+LJ_FUNC size_t lj_str_bufnumf(char *s, lua_Number n, int prec);
 LJ_FUNC size_t LJ_FASTCALL lj_str_bufnum(char *s, cTValue *o);
 LJ_FUNC char * LJ_FASTCALL lj_str_bufint(char *p, int32_t k);
 LJ_FUNCA GCstr * LJ_FASTCALL lj_str_fromnum(lua_State *L, const lua_Number *np);
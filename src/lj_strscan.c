@@ -71,6 +71,19 @@
 
 #define casecmp(c, k)	(((c) | 0x20) == k)
 
+/* The decimal fast path needs correctly rounded double arithmetic. */
+#if LJ_TARGET_X86 && !defined(__SSE2_MATH__)
+#define STRSCAN_FASTDEC		0	/* x87 rounds to extended precision. */
+#else
+#define STRSCAN_FASTDEC		1
+
+/* Powers of ten, which are exactly representable as doubles. */
+static const double strscan_pow10[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
 /* Final conversion to double. */
 static void strscan_double(uint64_t x, TValue *o, int32_t ex2, int32_t neg)
 {
@@ -184,6 +197,28 @@ static StrScanFmt strscan_dec(const uint8_t *p, TValue *o,
 {
   uint8_t xi[STRSCAN_DDIG], *xip = xi;
 
+#if STRSCAN_FASTDEC
+  /* Fast path for up to 19 digits and a small exponent (Clinger). */
+  if (fmt == STRSCAN_NUM && dig <= 19 && ex10 >= -22 && ex10 <= 22+15) {
+    const uint8_t *q = p;
+    uint32_t i;
+    int32_t e = ex10;
+    uint64_t x = 0;
+    for (i = dig; i > 0; i--, q++)
+      x = x * 10 + ((*q != '.' ? *q : *++q) & 15);
+    for ( ; e > 22 && x < ((uint64_t)1 << 53); e--)
+      x *= 10;  /* Move excess exponent into mantissa, while exact. */
+    if (x <= ((uint64_t)1 << 53) && e <= 22) {
+      /* Both operands are exact, so the result is correctly rounded. */
+      double n = (double)(int64_t)x;
+      if (e < 0) n /= strscan_pow10[-e];
+      else if (e > 0) n *= strscan_pow10[e];
+      o->n = neg ? -n : n;
+      return fmt;
+    }
+  }
+#endif
+
   if (dig) {
     uint32_t i = dig;
     if (i > STRSCAN_MAXDIG) {
@@ -158,6 +158,10 @@ void LJ_FASTCALL lj_trace_free(global_State *g, GCtrace *T)
   jit_State *J = G2J(g);
   if (T->traceno) {
     lj_gdbjit_deltrace(J, T);
+    if (T->mcode)  /* Reclaim machine code. Nothing can link to it anymore. */
+      lj_mcode_release(J, T->mcode, T->szmcalloc);
+    if (T->szmccold)
+      lj_mcode_release(J, T->mccold, T->szmccold);
     if (T->traceno < J->freetrace)
       J->freetrace = T->traceno;
     setgcrefnull(J->trace[T->traceno]);
@@ -367,7 +371,7 @@ static void trace_start(jit_State *J)
   TraceNo traceno;
 
   if ((J->pt->flags & PROTO_NOJIT)) {  /* JIT disabled for this proto? */
-    if (J->parent == 0) {
+    if (J->parent == 0 && J->exitno == 0) {
       /* Lazy bytecode patching to disable hotcount events. */
       lua_assert(bc_op(*J->pc) == BC_FORL || bc_op(*J->pc) == BC_ITERL ||
 		 bc_op(*J->pc) == BC_LOOP || bc_op(*J->pc) == BC_FUNCF);
@@ -447,6 +451,15 @@ static void trace_stop(jit_State *J)
   case BC_RET1:
     *pc = BCINS_AD(BC_JLOOP, J->cur.snap[0].nslots, traceno);
     goto addroot;
+  case BC_CALL:
+  case BC_CALLM:
+    /* Trace stitching: patch link of previous trace. */
+    {
+      GCtrace *Tp = traceref(J, J->exitno);
+      if (Tp && Tp->linktype == LJ_TRLINK_STITCH)
+	Tp->link = (TraceNo1)traceno;
+    }
+    break;
   case BC_JMP:
     /* Patch exit branch in parent to side trace entry. */
     lua_assert(J->parent != 0 && J->cur.root != 0);
@@ -510,8 +523,15 @@ static int trace_abort(jit_State *J)
     return 1;  /* Retry ASM with new MCode area. */
   }
   /* Penalize or blacklist starting bytecode instruction. */
-  if (J->parent == 0 && !bc_isret(bc_op(J->cur.startins)))
-    penalty_pc(J, &gcref(J->cur.startpt)->pt, mref(J->cur.startpc, BCIns), e);
+  if (J->parent == 0 && !bc_isret(bc_op(J->cur.startins))) {
+    if (J->exitno == 0) {
+      penalty_pc(J, &gcref(J->cur.startpt)->pt, mref(J->cur.startpc, BCIns), e);
+    } else {  /* Stitched trace: blacklist by self-linking previous trace. */
+      GCtrace *Tp = traceref(J, J->exitno);
+      if (Tp && Tp->linktype == LJ_TRLINK_STITCH)
+	Tp->link = Tp->traceno;
+    }
+  }
 
   /* Is there anything to abort? */
   traceno = J->cur.traceno;
@@ -622,6 +642,7 @@ static TValue *trace_state(lua_State *L, lua_CFunction dummy, void *ud)
     case LJ_TRACE_ASM:
       setvmstate(J2G(J), ASM);
       lj_asm_trace(J, &J->cur);
+      lj_snap_compress(J);
       trace_stop(J);
       setvmstate(J2G(J), INTERP);
       J->state = LJ_TRACE_IDLE;
@@ -675,17 +696,51 @@ void LJ_FASTCALL lj_trace_hot(jit_State *J, const BCIns *pc)
   ERRNO_RESTORE
 }
 
+/* A call returned to the continuation of a stitched trace.
+** J->exitno holds the number of the previous trace. Start a new trace.
+*/
+void LJ_FASTCALL lj_trace_stitch(jit_State *J, const BCIns *pc)
+{
+  /* Note: pc is the interpreter bytecode PC here. It's offset by 1. */
+  GCtrace *T = traceref(J, J->exitno);
+  ERRNO_SAVE
+  /* Check that the previous trace really ends with a stitch to this call. */
+  if (T && T->linktype == LJ_TRLINK_STITCH && T->link != T->traceno &&
+      T->nsnap > 0 && (J->flags & JIT_F_ON) && J->state == LJ_TRACE_IDLE &&
+      !(curr_proto(J->L)->flags & PROTO_NOJIT) &&
+      !(J2G(J)->hookmask & (HOOK_GC|HOOK_VMEVENT))) {
+    SnapShot *snap = &T->snap[T->nsnap-1];
+    SnapEntry mapbuf[SNAP_MAXMAP];
+    SnapEntry *map = lj_snap_map(T, T->nsnap-1, mapbuf);
+    if (map[snap->nent + 2] == SNAP_MKPC(pc)) {
+      T->link = 0;  /* Previous link is stale, if any. */
+      J->parent = 0;  /* Root trace, but J->exitno != 0 marks stitching. */
+      J->state = LJ_TRACE_START;
+      lj_trace_ins(J, pc-1);
+    }
+  }
+  ERRNO_RESTORE
+}
+
 /* Check for a hot side exit. If yes, start recording a side trace. */
 static void trace_hotside(jit_State *J, const BCIns *pc)
 {
   SnapShot *snap = &traceref(J, J->parent)->snap[J->exitno];
   if (!(J2G(J)->hookmask & (HOOK_GC|HOOK_VMEVENT)) &&
-      snap->count != SNAPCOUNT_DONE &&
-      ++snap->count >= J->param[JIT_P_hotexit]) {
-    lua_assert(J->state == LJ_TRACE_IDLE);
-    /* J->parent is non-zero for a side trace. */
-    J->state = LJ_TRACE_START;
-    lj_trace_ins(J, pc);
+      snap->count != SNAPCOUNT_DONE) {
+    int32_t fails = (int32_t)snap->count - J->param[JIT_P_hotexit] + 1;
+    if (fails > 0 && J->param[JIT_P_backoff] > 0) {
+      /* Retry a failed side trace with exponentially lower probability. */
+      int32_t bits = fails * J->param[JIT_P_backoff];
+      if (LJ_PRNG_BITS(J, bits < 16 ? bits : 16) != 0)
+	return;
+    }
+    if (++snap->count >= J->param[JIT_P_hotexit]) {
+      lua_assert(J->state == LJ_TRACE_IDLE);
+      /* J->parent is non-zero for a side trace. */
+      J->state = LJ_TRACE_START;
+      lj_trace_ins(J, pc);
+    }
   }
 }
 
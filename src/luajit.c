@@ -379,12 +379,16 @@ static int dojitopt(lua_State *L, const char *opt)
 }
 
 /* Save or list bytecode. */
-static int dobytecode(lua_State *L, char **argv)
+static int dobytecode(lua_State *L, char **argv, int n)
 {
-  int narg = 0;
+  int narg = getargs(L, argv, n);  /* Set arg table, but drop arguments. */
+  lua_setglobal(L, "arg");
+  lua_pop(L, narg);
+  narg = 0;
   lua_pushliteral(L, "bcsave");
   if (loadjitmodule(L))
     return 1;
+  argv += n;
   if (argv[0][2]) {
     narg++;
     argv[0][1] = '-';
@@ -484,7 +488,7 @@ static int runargs(lua_State *L, char **argv, int n)
 	return 1;
       break;
     case 'b':  /* LuaJIT extension */
-      return dobytecode(L, argv+i);
+      return dobytecode(L, argv, i);
     default: break;
     }
   }
@@ -64,6 +64,9 @@ enum {
 /* Control the JIT engine. */
 LUA_API int luaJIT_setmode(lua_State *L, int idx, int mode);
 
+/* Set max. size of the pool of recycled coroutines. */
+LUA_API int luaJIT_threadpool(lua_State *L, int size);
+
 /* Enforce (dynamic) linker error for version mismatches. Call from main. */
 LUA_API void LUAJIT_VERSION_SYM(void);
 
@@ -0,0 +1,16 @@
+-- TSETM on a table slot that was never loaded on trace.
+-- Compiled and interpreted results must match.
+local function g(x) return math.floor(x) end
+local function run()
+  local n = 0
+  for i=1,2000 do
+    local s = "x"..i
+    local t = {i, g(i+0.5)}
+    n = n + t[1] + t[2] + #t + #s
+  end
+  return n
+end
+jit.off(run, true)
+local ref = run()
+jit.on(run, true)
+assert(run() == ref and ref == 4014893)
@@ -0,0 +1,16 @@
+-- Closing an upvalue must see the stack slot, even if the slot is written
+-- again before the next UCLO. Compiled and interpreted results must match.
+local function run()
+  local s = 0
+  for i=1,2000 do
+    local a, b
+    do local x = i+0.5; a = function() return x end end
+    do local x = i*2; b = function() return x end end
+    s = s + a() + b()
+  end
+  return s
+end
+jit.off(run, true)
+local ref = run()
+jit.on(run, true)
+assert(run() == ref and ref == 6004000)